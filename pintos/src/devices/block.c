@@ -3,7 +3,21 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Timer ticks a queued request may wait while the elevator serves
+   others before it is dispatched out of order.  Reads, which
+   someone is usually waiting for, expire sooner than writes. */
+#define READ_EXPIRE (TIMER_FREQ / 2)
+#define WRITE_EXPIRE (TIMER_FREQ * 5)
+
+/* Most sectors that queued requests are merged into for one
+   dispatch to the driver.  A single larger request is dispatched
+   on its own. */
+#define MERGE_MAX 64
 
 /* A block device. */
 struct block {
@@ -18,6 +32,15 @@ struct block {
 
   unsigned long long read_cnt;  /* Number of sectors read. */
   unsigned long long write_cnt; /* Number of sectors written. */
+
+  /* Request queue, served by a worker thread started with the
+     first request. */
+  struct lock queue_lock;      /* Protects the members below. */
+  struct condition queue_cond; /* Signalled when a request is queued. */
+  struct list sorted;          /* Queued requests in ascending sector order. */
+  struct list fifo[2];         /* Queued requests by enum block_op, oldest first. */
+  block_sector_t head;         /* Sector after the last one dispatched. */
+  bool worker_started;         /* Has the worker thread been created? */
 };
 
 /* List of all block devices. */
@@ -27,6 +50,13 @@ static struct list all_blocks = LIST_INITIALIZER(all_blocks);
 static struct block* block_by_role[BLOCK_ROLE_CNT];
 
 static struct block* list_elem_to_block(struct list_elem*);
+static void block_transfer(struct block*, enum block_op, block_sector_t, void** buffers,
+                           size_t cnt);
+static void wake_submitter(struct block_request*);
+static bool request_less(const struct list_elem*, const struct list_elem*, void* aux);
+static struct block_request* pick_request(struct block*);
+static void dispatch(struct block*, enum block_op, block_sector_t, void** buffers, size_t cnt);
+static void block_worker(void* block_);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -95,9 +125,7 @@ static void check_sector(struct block* block, block_sector_t sector) {
    Internally synchronizes accesses to block devices, so external
    per-block device locking is unneeded. */
 void block_read(struct block* block, block_sector_t sector, void* buffer) {
-  check_sector(block, sector);
-  block->ops->read(block->aux, sector, buffer);
-  block->read_cnt++;
+  block_transfer(block, BLOCK_OP_READ, sector, &buffer, 1);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -106,10 +134,182 @@ void block_read(struct block* block, block_sector_t sector, void* buffer) {
    Internally synchronizes accesses to block devices, so external
    per-block device locking is unneeded. */
 void block_write(struct block* block, block_sector_t sector, const void* buffer) {
-  check_sector(block, sector);
-  ASSERT(block->type != BLOCK_FOREIGN);
-  block->ops->write(block->aux, sector, buffer);
-  block->write_cnt++;
+  block_transfer(block, BLOCK_OP_WRITE, sector, (void**)&buffer, 1);
+}
+
+/* Reads the CNT consecutive sectors of BLOCK starting at SECTOR,
+   each into the BLOCK_SECTOR_SIZE-byte buffer at the same index of
+   BUFFERS.  Lets callers hand a whole run to the block layer at
+   once. */
+void block_readv(struct block* block, block_sector_t sector, void* buffers[], size_t cnt) {
+  block_transfer(block, BLOCK_OP_READ, sector, buffers, cnt);
+}
+
+/* Writes the CNT consecutive sectors of BLOCK starting at SECTOR,
+   each from the BLOCK_SECTOR_SIZE-byte buffer at the same index of
+   BUFFERS.  Returns after the device has acknowledged them all. */
+void block_writev(struct block* block, block_sector_t sector, const void* buffers[], size_t cnt) {
+  block_transfer(block, BLOCK_OP_WRITE, sector, (void**)buffers, cnt);
+}
+
+/* Submits a request for the CNT sectors of BLOCK starting at
+   SECTOR and waits for it to complete. */
+static void block_transfer(struct block* block, enum block_op op, block_sector_t sector,
+                           void** buffers, size_t cnt) {
+  struct block_request req;
+  struct semaphore done;
+
+  if (cnt == 0)
+    return;
+  sema_init(&done, 0);
+  req.op = op;
+  req.sector = sector;
+  req.cnt = cnt;
+  req.buffers = buffers;
+  req.done = wake_submitter;
+  req.aux = &done;
+  block_submit(block, &req);
+  sema_down(&done);
+}
+
+/* Completion function for block_transfer(). */
+static void wake_submitter(struct block_request* req) { sema_up(req->aux); }
+
+/* Queues REQ on BLOCK and returns without waiting for it.  Once
+   the transfer is complete, REQ->done is called from BLOCK's
+   worker thread.
+
+   Requests are not served in the order submitted.  The elevator
+   takes them in ascending sector order, sweeping back to the
+   lowest sector at the end of each pass, and merges each with the
+   queued requests that continue it, unless a request has waited
+   past its deadline.  Requests that overlap must therefore not be
+   outstanding at the same time. */
+void block_submit(struct block* block, struct block_request* req) {
+  ASSERT(req->cnt > 0);
+  ASSERT(req->op == BLOCK_OP_READ || block->type != BLOCK_FOREIGN);
+  check_sector(block, req->sector);
+  check_sector(block, req->sector + req->cnt - 1);
+
+  lock_acquire(&block->queue_lock);
+  if (!block->worker_started) {
+    char name[sizeof block->name + 4];
+    snprintf(name, sizeof name, "blk-%s", block->name);
+    if (thread_create(name, PRI_DEFAULT, block_worker, block) == TID_ERROR)
+      PANIC("%s: cannot start request queue", block->name);
+    block->worker_started = true;
+  }
+  req->deadline = timer_ticks() + (req->op == BLOCK_OP_READ ? READ_EXPIRE : WRITE_EXPIRE);
+  list_insert_ordered(&block->sorted, &req->sort_elem, request_less, NULL);
+  list_push_back(&block->fifo[req->op], &req->fifo_elem);
+  if (req->op == BLOCK_OP_READ)
+    block->read_cnt += req->cnt;
+  else
+    block->write_cnt += req->cnt;
+  cond_signal(&block->queue_cond, &block->queue_lock);
+  lock_release(&block->queue_lock);
+}
+
+/* Orders requests by first sector, for the sorted queue. */
+static bool request_less(const struct list_elem* a_, const struct list_elem* b_,
+                         void* aux UNUSED) {
+  const struct block_request* a = list_entry(a_, struct block_request, sort_elem);
+  const struct block_request* b = list_entry(b_, struct block_request, sort_elem);
+  return a->sector < b->sector;
+}
+
+/* Chooses the next request to dispatch from BLOCK's queue, which
+   must not be empty: the oldest read or, failing that, write whose
+   deadline has passed, or else the first request at or after the
+   head, or else the lowest one. */
+static struct block_request* pick_request(struct block* block) {
+  int64_t now = timer_ticks();
+  struct list_elem* e;
+  int op;
+
+  for (op = BLOCK_OP_READ; op <= BLOCK_OP_WRITE; op++) {
+    if (!list_empty(&block->fifo[op])) {
+      struct block_request* req =
+          list_entry(list_front(&block->fifo[op]), struct block_request, fifo_elem);
+      if (req->deadline <= now)
+        return req;
+    }
+  }
+  for (e = list_begin(&block->sorted); e != list_end(&block->sorted); e = list_next(e)) {
+    struct block_request* req = list_entry(e, struct block_request, sort_elem);
+    if (req->sector >= block->head)
+      return req;
+  }
+  return list_entry(list_front(&block->sorted), struct block_request, sort_elem);
+}
+
+/* Transfers the CNT sectors of BLOCK starting at SECTOR through
+   its driver, in one operation if the driver supports it. */
+static void dispatch(struct block* block, enum block_op op, block_sector_t sector,
+                     void** buffers, size_t cnt) {
+  size_t i;
+
+  if (op == BLOCK_OP_READ && block->ops->readv != NULL) {
+    block->ops->readv(block->aux, sector, buffers, cnt);
+    return;
+  }
+  if (op == BLOCK_OP_WRITE && block->ops->writev != NULL) {
+    block->ops->writev(block->aux, sector, (const void**)buffers, cnt);
+    return;
+  }
+  for (i = 0; i < cnt; i++) {
+    if (op == BLOCK_OP_READ)
+      block->ops->read(block->aux, sector + i, buffers[i]);
+    else
+      block->ops->write(block->aux, sector + i, buffers[i]);
+  }
+}
+
+/* Serves the request queue of BLOCK_, which is a struct block.
+   Each request the elevator picks is dispatched together with the
+   queued requests that continue it, and all of them are then
+   completed. */
+static void block_worker(void* block_) {
+  struct block* block = block_;
+  void* buffers[MERGE_MAX];
+
+  for (;;) {
+    struct list batch;
+    struct block_request* req;
+    struct block_request* first;
+    block_sector_t sector;
+    size_t cnt = 0;
+
+    lock_acquire(&block->queue_lock);
+    while (list_empty(&block->sorted))
+      cond_wait(&block->queue_cond, &block->queue_lock);
+    list_init(&batch);
+    first = req = pick_request(block);
+    sector = req->sector;
+    for (;;) {
+      struct list_elem* next = list_next(&req->sort_elem);
+
+      list_remove(&req->sort_elem);
+      list_remove(&req->fifo_elem);
+      list_push_back(&batch, &req->sort_elem);
+      if (req != first || req->cnt <= MERGE_MAX)
+        memcpy(buffers + cnt, req->buffers, req->cnt * sizeof *buffers);
+      cnt += req->cnt;
+      if (next == list_end(&block->sorted))
+        break;
+      req = list_entry(next, struct block_request, sort_elem);
+      if (req->op != first->op || req->sector != sector + cnt || cnt + req->cnt > MERGE_MAX)
+        break;
+    }
+    block->head = sector + cnt;
+    lock_release(&block->queue_lock);
+
+    dispatch(block, first->op, sector, cnt > MERGE_MAX ? first->buffers : buffers, cnt);
+    while (!list_empty(&batch)) {
+      req = list_entry(list_pop_front(&batch), struct block_request, sort_elem);
+      req->done(req);
+    }
+  }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -153,6 +353,13 @@ struct block* block_register(const char* name, enum block_type type, const char*
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  lock_init(&block->queue_lock);
+  cond_init(&block->queue_cond);
+  list_init(&block->sorted);
+  list_init(&block->fifo[BLOCK_OP_READ]);
+  list_init(&block->fifo[BLOCK_OP_WRITE]);
+  block->head = 0;
+  block->worker_started = false;
 
   printf("%s: %'" PRDSNu " sectors (", block->name, block->size);
   print_human_readable_size((uint64_t)block->size * BLOCK_SECTOR_SIZE);
@@ -171,9 +378,10 @@ static struct block* list_elem_to_block(struct list_elem* list_elem) {
                                              : NULL);
 }
 
-/* Return the write_cnt of the first block device */
+/* Returns the number of sectors written to the file system
+   device so far. */
 unsigned long long get_block_write_cnt(void) {
-  struct block* block = block_by_role[0];
+  struct block* block = block_by_role[BLOCK_FILESYS];
   if (block != NULL) {
     return block->write_cnt;
   }
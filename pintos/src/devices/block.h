@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
 
 unsigned long long get_block_write_cnt(void);
 /* Size of a block device sector in bytes.
@@ -53,17 +54,53 @@ struct block* block_next(struct block*);
 block_sector_t block_size(struct block*);
 void block_read(struct block*, block_sector_t, void*);
 void block_write(struct block*, block_sector_t, const void*);
+void block_readv(struct block*, block_sector_t, void* buffers[], size_t cnt);
+void block_writev(struct block*, block_sector_t, const void* buffers[], size_t cnt);
 const char* block_name(struct block*);
 enum block_type block_type(struct block*);
 
+/* Asynchronous requests. */
+
+/* Direction of a block request. */
+enum block_op {
+  BLOCK_OP_READ, /* Device to memory. */
+  BLOCK_OP_WRITE /* Memory to device. */
+};
+
+/* A request to transfer CNT consecutive sectors starting at
+   SECTOR, each to or from the BLOCK_SECTOR_SIZE-byte buffer at the
+   same index of BUFFERS.  The submitter owns the request and its
+   buffers until DONE has been called. */
+struct block_request {
+  enum block_op op;                     /* Read or write. */
+  block_sector_t sector;                /* First sector. */
+  size_t cnt;                           /* Number of sectors. */
+  void** buffers;                       /* CNT sector buffers. */
+  void (*done)(struct block_request*); /* Called once transferred. */
+  void* aux;                            /* For use by DONE. */
+
+  /* Owned by the block layer. */
+  struct list_elem sort_elem; /* Element in the device's sorted queue. */
+  struct list_elem fifo_elem; /* Element in the device's FIFO for OP. */
+  int64_t deadline;           /* Timer tick by which to dispatch. */
+};
+
+void block_submit(struct block*, struct block_request*);
+
 /* Statistics. */
 void block_print_stats(void);
 
 /* Lower-level interface to block device drivers. */
 
+/* READV and WRITEV transfer a run of consecutive sectors, each to
+   or from the buffer at the same index of BUFFERS, in as few device
+   operations as the driver can.  A driver without them may leave
+   them null, and runs are then transferred a sector at a time. */
 struct block_operations {
   void (*read)(void* aux, block_sector_t, void* buffer);
   void (*write)(void* aux, block_sector_t, const void* buffer);
+  void (*readv)(void* aux, block_sector_t, void* buffers[], size_t cnt);
+  void (*writev)(void* aux, block_sector_t, const void* buffers[], size_t cnt);
 };
 
 struct block* block_register(const char* name, enum block_type, const char* extra_info,
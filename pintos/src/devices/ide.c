@@ -34,6 +34,7 @@
 #define STA_BSY 0x80  /* Busy. */
 #define STA_DRDY 0x40 /* Device Ready. */
 #define STA_DRQ 0x08  /* Data Request. */
+#define STA_ERR 0x01  /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04 /* Software Reset. */
@@ -49,6 +50,13 @@
 #define CMD_IDENTIFY_DEVICE 0xec    /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20  /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30 /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4      /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5     /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6  /* SET MULTIPLE MODE. */
+
+/* Most sectors one read or write command transfers: a sector
+   count of 0 in the Sector Count register means 256. */
+#define MAX_SECTORS 256
 
 /* An ATA device. */
 struct ata_disk {
@@ -56,6 +64,8 @@ struct ata_disk {
   struct channel* channel; /* Channel that disk is attached to. */
   int dev_no;              /* Device 0 or 1 for master or slave. */
   bool is_ata;             /* Is device an ATA disk? */
+  int multiple;            /* Sectors per interrupt with READ/WRITE
+                              MULTIPLE, or 0 to use READ/WRITE SECTOR. */
 };
 
 /* An ATA channel (aka controller).
@@ -82,8 +92,9 @@ static struct block_operations ide_operations;
 static void reset_channel(struct channel*);
 static bool check_device_type(struct ata_disk*);
 static void identify_ata_device(struct ata_disk*);
+static void set_multiple_mode(struct ata_disk*, int max);
 
-static void select_sector(struct ata_disk*, block_sector_t);
+static void select_sector(struct ata_disk*, block_sector_t, size_t cnt);
 static void issue_pio_command(struct channel*, uint8_t command);
 static void input_sector(struct channel*, void*);
 static void output_sector(struct channel*, const void*);
@@ -128,6 +139,7 @@ void ide_init(void) {
       d->channel = c;
       d->dev_no = dev_no;
       d->is_ata = false;
+      d->multiple = 0;
     }
 
     /* Register interrupt handler. */
@@ -277,11 +289,32 @@ static void identify_ata_device(struct ata_disk* d) {
     return;
   }
 
+  /* Transfer as many sectors per interrupt as the disk allows. */
+  set_multiple_mode(d, *(uint16_t*)&id[47 * 2] & 0xff);
+
   /* Register. */
   block = block_register(d->name, BLOCK_RAW, extra_info, capacity, &ide_operations, d);
   partition_scan(block);
 }
 
+/* Enables READ/WRITE MULTIPLE on disk D with MAX sectors per
+   interrupt, the most it supports according to IDENTIFY DEVICE,
+   if MAX is a power of 2 greater than 1.  Leaves D using READ/WRITE
+   SECTOR otherwise or if the disk rejects the command. */
+static void set_multiple_mode(struct ata_disk* d, int max) {
+  struct channel* c = d->channel;
+
+  if (max < 2 || (max & (max - 1)) != 0)
+    return;
+  select_device_wait(d);
+  outb(reg_nsect(c), max);
+  issue_pio_command(c, CMD_SET_MULTIPLE_MODE);
+  sema_down(&c->completion_wait);
+  wait_while_busy(d);
+  if (!(inb(reg_alt_status(c)) & STA_ERR))
+    d->multiple = max;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -306,53 +339,105 @@ static char* descramble_ata_string(char* string, int size) {
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads the CNT consecutive sectors of disk D starting at SEC_NO,
+   each into the buffer at the same index of BUFFERS, which must
+   have room for BLOCK_SECTOR_SIZE bytes.  Issues one command per
+   MAX_SECTORS sectors, and with READ MULTIPLE takes one interrupt
+   per d->multiple sectors rather than one per sector.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
-static void ide_read(void* d_, block_sector_t sec_no, void* buffer) {
+static void ide_readv(void* d_, block_sector_t sec_no, void* buffers[], size_t cnt) {
   struct ata_disk* d = d_;
   struct channel* c = d->channel;
+  size_t per_intr = d->multiple > 0 ? (size_t)d->multiple : 1;
+
   lock_acquire(&c->lock);
-  select_sector(d, sec_no);
-  issue_pio_command(c, CMD_READ_SECTOR_RETRY);
-  sema_down(&c->completion_wait);
-  if (!wait_while_busy(d))
-    PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no);
-  input_sector(c, buffer);
+  while (cnt > 0) {
+    size_t n = cnt < MAX_SECTORS ? cnt : MAX_SECTORS;
+    size_t i;
+
+    select_sector(d, sec_no, n);
+    issue_pio_command(c, d->multiple > 0 ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY);
+    for (i = 0; i < n; i++) {
+      if (i % per_intr == 0) {
+        sema_down(&c->completion_wait);
+        if (!wait_while_busy(d))
+          PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no + i);
+      }
+      input_sector(c, buffers[i]);
+    }
+    sec_no += n;
+    buffers += n;
+    cnt -= n;
+  }
   lock_release(&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes the CNT consecutive sectors of disk D starting at SEC_NO,
+   each from the buffer at the same index of BUFFERS, which must
+   contain BLOCK_SECTOR_SIZE bytes.  Issues commands as
+   ide_readv() does.  Returns after the disk has acknowledged
+   receiving the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
-static void ide_write(void* d_, block_sector_t sec_no, const void* buffer) {
+static void ide_writev(void* d_, block_sector_t sec_no, const void* buffers[], size_t cnt) {
   struct ata_disk* d = d_;
   struct channel* c = d->channel;
+  size_t per_intr = d->multiple > 0 ? (size_t)d->multiple : 1;
+
   lock_acquire(&c->lock);
-  select_sector(d, sec_no);
-  issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy(d))
-    PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no);
-  output_sector(c, buffer);
-  sema_down(&c->completion_wait);
+  while (cnt > 0) {
+    size_t n = cnt < MAX_SECTORS ? cnt : MAX_SECTORS;
+    size_t i;
+
+    select_sector(d, sec_no, n);
+    issue_pio_command(c, d->multiple > 0 ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY);
+    for (i = 0; i < n; i++) {
+      if (i % per_intr == 0) {
+        /* The disk interrupts once it has taken each block of
+           sectors, the last one included. */
+        if (i > 0)
+          sema_down(&c->completion_wait);
+        if (!wait_while_busy(d))
+          PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no + i);
+      }
+      output_sector(c, buffers[i]);
+    }
+    sema_down(&c->completion_wait);
+    sec_no += n;
+    buffers += n;
+    cnt -= n;
+  }
   lock_release(&c->lock);
 }
 
-static struct block_operations ide_operations = {ide_read, ide_write};
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes. */
+static void ide_read(void* d, block_sector_t sec_no, void* buffer) {
+  ide_readv(d, sec_no, &buffer, 1);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data. */
+static void ide_write(void* d, block_sector_t sec_no, const void* buffer) {
+  ide_writev(d, sec_no, &buffer, 1);
+}
+
+static struct block_operations ide_operations = {ide_read, ide_write, ide_readv, ide_writev};
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
-static void select_sector(struct ata_disk* d, block_sector_t sec_no) {
+   writes SEC_NO to the disk's sector selection registers and CNT,
+   at most MAX_SECTORS, to its sector count register.  (We use LBA
+   mode.) */
+static void select_sector(struct ata_disk* d, block_sector_t sec_no, size_t cnt) {
   struct channel* c = d->channel;
 
   ASSERT(sec_no < (1UL << 28));
+  ASSERT(cnt > 0 && cnt <= MAX_SECTORS);
 
   select_device_wait(d);
-  outb(reg_nsect(c), 1);
+  outb(reg_nsect(c), cnt);
   outb(reg_lbal(c), sec_no);
   outb(reg_lbam(c), sec_no >> 8);
   outb(reg_lbah(c), (sec_no >> 16));
@@ -286,4 +286,22 @@ static void partition_write(void* p_, block_sector_t sector, const void* buffer)
   block_write(p->block, p->start + sector, buffer);
 }
 
-static struct block_operations partition_operations = {partition_read, partition_write};
+/* Reads the CNT consecutive sectors of partition P starting at
+   SECTOR, each into the buffer at the same index of BUFFERS, with
+   one request to the underlying block device. */
+static void partition_readv(void* p_, block_sector_t sector, void* buffers[], size_t cnt) {
+  struct partition* p = p_;
+  block_readv(p->block, p->start + sector, buffers, cnt);
+}
+
+/* Writes the CNT consecutive sectors of partition P starting at
+   SECTOR, each from the buffer at the same index of BUFFERS, with
+   one request to the underlying block device. */
+static void partition_writev(void* p_, block_sector_t sector, const void* buffers[],
+                             size_t cnt) {
+  struct partition* p = p_;
+  block_writev(p->block, p->start + sector, buffers, cnt);
+}
+
+static struct block_operations partition_operations = {partition_read, partition_write,
+                                                       partition_readv, partition_writev};
@@ -20,34 +20,40 @@ static bool list_dir(const char* dir, bool verbose) {
   }
 
   if (isdir(dir_fd)) {
-    char name[READDIR_MAX_LEN];
+    struct dirent entries[32];
+    int cnt;
 
     printf("%s", dir);
     if (verbose)
       printf(" (inumber %d)", inumber(dir_fd));
     printf(":\n");
 
-    while (readdir(dir_fd, name)) {
-      printf("%s", name);
-      if (verbose) {
-        char full_name[128];
-        int entry_fd;
+    while ((cnt = getdents(dir_fd, entries, sizeof entries)) > 0) {
+      int i;
+      for (i = 0; i < cnt; i++) {
+        struct dirent* e = &entries[i];
 
-        snprintf(full_name, sizeof full_name, "%s/%s", dir, name);
-        entry_fd = open(full_name);
-
-        printf(": ");
-        if (entry_fd != -1) {
-          if (isdir(entry_fd))
+        printf("%s", e->name);
+        if (verbose) {
+          printf(": ");
+          if (e->is_dir)
             printf("directory");
-          else
-            printf("%d-byte file", filesize(entry_fd));
-          printf(", inumber %d", inumber(entry_fd));
-        } else
-          printf("open failed");
-        close(entry_fd);
+          else {
+            char full_name[128];
+            int entry_fd;
+
+            snprintf(full_name, sizeof full_name, "%s/%s", dir, e->name);
+            entry_fd = open(full_name);
+            if (entry_fd != -1)
+              printf("%d-byte file", filesize(entry_fd));
+            else
+              printf("open failed");
+            close(entry_fd);
+          }
+          printf(", inumber %d", e->inumber);
+        }
+        printf("\n");
       }
-      printf("\n");
     }
   } else
     printf("%s: not a directory\n", dir);
@@ -3,99 +3,1068 @@
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stdlib.h>
 #include <string.h>
 #include "filesys/filesys.h"
-#include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
-#define MAXSIZE 64
-/* Returns the cache entry given a sector, 
-if it is not in the cache we bring it in 
+/* The flusher runs every FLUSH_INTERVAL timer ticks, and earlier
+   once more than DIRTY_HIGH entries are dirty. */
+#define FLUSH_INTERVAL TIMER_FREQ
+#define DIRTY_HIGH ((int)cache_size / 4)
+
+/* Most consecutive sectors moved to or from disk in one request. */
+#define RUN_BATCH 16
+
+/* Most write-back requests in flight at once. */
+#define WRITE_BACK_DEPTH 4
+
+/* A run of consecutive dirty entries being written back. */
+struct write_batch {
+  struct block_request req;               /* Request writing the run. */
+  struct cache_entry* entries[RUN_BATCH]; /* The entries, locked. */
+  void* bufs[RUN_BATCH];                  /* Their frames. */
+};
+
+/* A remembered, non-resident sector.  ARC keeps the sectors it
+   recently evicted so that a miss on one of them tells it which
+   of its two lists deserves more space. */
+struct cache_ghost {
+  struct list_elem elem;      /* Element in b1, b2 or free_ghosts. */
+  struct hash_elem hash_elem; /* Element in ghost_index. */
+  block_sector_t sector;      /* Sector that was evicted. */
+  struct list* queue;         /* Ghost list holding this record. */
+};
+
+/* Replacement policy, chosen with the -cache kernel option. */
+enum cache_policy cache_policy = CACHE_ARC;
+
+/* Cache capacity in sectors, chosen with the -cache-size kernel
+   option. */
+size_t cache_size = CACHE_DEFAULT_SIZE;
+
+/* Returns the cache entry given a sector,
+if it is not in the cache we bring it in
 and evict another entry if necessary. */
-struct cache_entry* get_cache_entry( struct block* b, block_sector_t sec); 
+struct cache_entry* get_cache_entry(struct block* b, block_sector_t sec, bool read);
 
-void LRU_evict(struct block*);
+static struct cache_entry* clean_victim(struct block*, block_sector_t, bool in_b2);
+static void cache_replace(struct cache_entry*, bool discard);
+static struct cache_entry* pick_victim(struct list*);
+static bool has_room(void);
+static void entry_unlock(struct cache_entry*);
+static void ghost_push(struct list*, block_sector_t);
+static void ghost_drop_lru(struct list*);
+static void ghost_remove(struct cache_ghost*);
+static struct cache_ghost* ghost_lookup(block_sector_t sec);
+
+static unsigned cache_hash(const struct hash_elem* e, void* aux UNUSED);
+static bool cache_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED);
+static unsigned ghost_hash(const struct hash_elem* e, void* aux UNUSED);
+static bool ghost_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED);
+static struct cache_entry* cache_lookup(block_sector_t sec);
+static void cache_acquire(struct cache_entry*);
+static struct cache_entry* cache_load(struct block*, block_sector_t, bool read);
+static struct cache_entry* cache_insert(struct block*, block_sector_t, bool prefetched);
+static void cache_touch(struct cache_entry*);
+static struct cache_entry* frame_to_entry(void* frame);
+static void entry_free(struct cache_entry*);
+static void mark_dirty(struct cache_entry*);
+static void mark_clean(struct cache_entry*);
+static void mark_logged(struct cache_entry*);
+static void clear_logged(struct cache_entry*);
+static void flusher(void* aux UNUSED);
+static size_t collect_dirty(block_sector_t* sectors);
+static void write_back(block_sector_t* sectors, size_t cnt);
+static void request_done(struct block_request*);
+static int compare_sectors(const void* a, const void* b);
 
 struct lock cache_lookup_lock;
-struct list cache;
+
+/* Resident lists, most recently used first.  Under LRU only t1
+   is used.  Under ARC, t1 holds sectors seen once recently and
+   t2 sectors seen at least twice. */
+struct list t1, t2;
+/* ARC ghost lists: sectors recently evicted from t1 and t2. */
+struct list b1, b2;
+size_t t1_cnt, t2_cnt, b1_cnt, b2_cnt;
+/* ARC's adaptive target size for t1. */
+size_t arc_p;
+
+struct hash cache_index;  /* Sector -> resident entry. */
+struct hash ghost_index;  /* Sector -> ghost record. */
 int hits;
 
-/* Flush the cache entries to disk. Clear the cache. */
+/* Storage for the whole cache, allocated once at boot so that a
+   miss never calls the allocator.  Sector data lives in a page-
+   aligned frame array, separate from the entry metadata, so each
+   frame is exactly one sector.  There is one entry more than
+   cache_size: a miss takes the spare before evicting. */
+static struct cache_entry* entries;  /* cache_size + 1 entries. */
+static char* frames;                 /* cache_size + 1 sector frames. */
+static struct cache_ghost* ghosts;   /* cache_size ghost records. */
+static struct list free_entries;     /* Entries not holding a sector. */
+static struct list free_ghosts;      /* Unused ghost records. */
+
+/* A miss that finds every entry busy waits on unpin_cond, with
+   cache_lookup_lock, until an entry is unlocked.  insert_waiters
+   counts the waiting threads, so that unlocking an entry takes the
+   lookup lock only when someone is waiting. */
+static struct condition unpin_cond;
+static int insert_waiters;
+
+/* Write-behind state.  dirty_cnt is also updated from
+   block_write_cached, so it is changed with interrupts off, as is
+   logged_cnt. */
+static int dirty_cnt;
+static size_t logged_cnt;           /* Entries in the running transaction. */
+static bool flush_pending;          /* Flusher already signalled? */
+static bool flusher_started;        /* Safe to signal from the timer? */
+static struct semaphore flush_sema; /* Up'd to wake the flusher. */
+static block_sector_t* flush_list;  /* cache_size sectors. */
+static block_sector_t* commit_list; /* cache_size sectors, for commits. */
+
+/* Flush the cache entries to disk. Clear the cache.  Entries
+   that another thread is waiting to use are written back but kept,
+   as are any logged by a transaction that started meanwhile.
+   Each entry is pinned under cache_lookup_lock and locked only
+   after that lock is released, as everywhere else. */
 void flush_cache() {
-  struct list_elem* e;
-  for (e = list_begin(&cache);
-    e != list_end(&cache); e = list_next(e)) {
-    struct cache_entry* entry = list_entry(e, struct cache_entry, elem);
-    list_remove(&entry->elem);
-    block_write(fs_device, entry->sector, entry->data);
+  size_t i;
+
+  journal_commit();
+  for (i = 0; i <= cache_size; i++) {
+    struct cache_entry* entry = &entries[i];
+
+    lock_acquire(&cache_lookup_lock);
+    if (entry->queue == NULL) {
+      lock_release(&cache_lookup_lock);
+      continue;
+    }
+    cache_acquire(entry);
+    if (entry->dirty_bit == 1 && !entry->logged) {
+      block_write(fs_device, entry->sector, entry->data);
+      mark_clean(entry);
+    }
+    lock_acquire(&cache_lookup_lock);
+    if (!entry->logged && entry->waiters == 0) {
+      list_remove(&entry->elem);
+      hash_delete(&cache_index, &entry->hash_elem);
+      if (entry->queue == &t1)
+        t1_cnt--;
+      else
+        t2_cnt--;
+      lock_release(&entry->lck);
+      entry_free(entry);
+    } else {
+      lock_release(&entry->lck);
+    }
+    if (insert_waiters > 0)
+      cond_broadcast(&unpin_cond, &cache_lookup_lock);
+    lock_release(&cache_lookup_lock);
   }
+
+  lock_acquire(&cache_lookup_lock);
+  while (!list_empty(&b1))
+    ghost_drop_lru(&b1);
+  while (!list_empty(&b2))
+    ghost_drop_lru(&b2);
+  arc_p = 0;
   hits = 0;
+  lock_release(&cache_lookup_lock);
 }
 
-/* Initializes the inode module. */
+/* Initializes the buffer cache, reserving memory for cache_size
+   sectors. */
 void cache_init(void) {
-  list_init(&cache);
+  size_t frame_pages = DIV_ROUND_UP((cache_size + 1) * BLOCK_SECTOR_SIZE, PGSIZE);
+  size_t i;
+
+  entries = malloc((cache_size + 1) * sizeof *entries);
+  ghosts = malloc(cache_size * sizeof *ghosts);
+  flush_list = malloc(cache_size * sizeof *flush_list);
+  commit_list = malloc(cache_size * sizeof *commit_list);
+  frames = palloc_get_multiple(0, frame_pages);
+  if (entries == NULL || ghosts == NULL || flush_list == NULL || commit_list == NULL ||
+      frames == NULL)
+    PANIC("not enough memory for a %zu-sector buffer cache", cache_size);
+  list_init(&free_entries);
+  list_init(&free_ghosts);
+  for (i = 0; i <= cache_size; i++) {
+    entries[i].data = frames + i * BLOCK_SECTOR_SIZE;
+    entries[i].queue = NULL;
+    lock_init(&entries[i].lck);
+    list_push_back(&free_entries, &entries[i].elem);
+  }
+  for (i = 0; i < cache_size; i++)
+    list_push_back(&free_ghosts, &ghosts[i].elem);
+
+  list_init(&t1);
+  list_init(&t2);
+  list_init(&b1);
+  list_init(&b2);
+  t1_cnt = t2_cnt = b1_cnt = b2_cnt = 0;
+  arc_p = 0;
+  if (!hash_init(&cache_index, cache_hash, cache_less, NULL) ||
+      !hash_init(&ghost_index, ghost_hash, ghost_less, NULL))
+    PANIC("buffer cache index creation failed");
   lock_init(&cache_lookup_lock);
+  cond_init(&unpin_cond);
+  insert_waiters = 0;
   hits = 0;
+
+  dirty_cnt = 0;
+  logged_cnt = 0;
+  flush_pending = false;
+  sema_init(&flush_sema, 0);
+  thread_create("cache-flusher", PRI_DEFAULT, flusher, NULL);
+  flusher_started = true;
+}
+
+/* Called by the timer interrupt handler on every tick; wakes the
+   flusher once per FLUSH_INTERVAL. */
+void cache_tick(int64_t ticks) {
+  if (flusher_started && ticks % FLUSH_INTERVAL == 0 && !flush_pending) {
+    flush_pending = true;
+    sema_up(&flush_sema);
+  }
+}
+
+/* Write-behind thread.  Each time it is woken, writes every dirty
+   entry that is not logged back to disk in ascending sector order,
+   so that eviction rarely has to write a victim on the path of a
+   read miss, and then commits the metadata journal, whose
+   transactions may refer to the data just written. */
+static void flusher(void* aux UNUSED) {
+  for (;;) {
+    sema_down(&flush_sema);
+    flush_pending = false;
+
+    /* Write the data before the commit, which would otherwise
+       write it while holding off new transactions. */
+    write_back(flush_list, collect_dirty(flush_list));
+    journal_commit();
+  }
+}
+
+/* Writes back the file data sectors that the running journal
+   transaction allocated, and takes them out of it.  The journal
+   calls this during each commit, before writing the log, so that
+   no committed metadata maps sectors whose data is only in the
+   cache.  Other dirty data is left to the flusher.  Commits are
+   serialized, and no transaction runs during one, so they can
+   share commit_list and clear the marks without entry locks. */
+void cache_write_ordered(void) {
+  struct list* lists[] = {&t1, &t2};
+  size_t cnt = 0;
+  size_t i;
+
+  lock_acquire(&cache_lookup_lock);
+  for (i = 0; i < 2; i++) {
+    struct list_elem* e;
+    for (e = list_begin(lists[i]); e != list_end(lists[i]); e = list_next(e)) {
+      struct cache_entry* entry = list_entry(e, struct cache_entry, elem);
+      if (entry->ordered) {
+        entry->ordered = false;
+        commit_list[cnt++] = entry->sector;
+      }
+    }
+  }
+  lock_release(&cache_lookup_lock);
+  write_back(commit_list, cnt);
+}
+
+/* Stores the dirty sectors that are not logged in SECTORS, which
+   must have room for cache_size of them, and returns how many
+   there are.  The snapshot lets them be written without holding
+   the lookup lock across the whole batch. */
+static size_t collect_dirty(block_sector_t* sectors) {
+  struct list* lists[] = {&t1, &t2};
+  size_t cnt = 0;
+  size_t i;
+
+  lock_acquire(&cache_lookup_lock);
+  for (i = 0; i < 2; i++) {
+    struct list_elem* e;
+    for (e = list_begin(lists[i]); e != list_end(lists[i]); e = list_next(e)) {
+      struct cache_entry* entry = list_entry(e, struct cache_entry, elem);
+      if (entry->dirty_bit == 1 && !entry->logged && cnt < cache_size)
+        sectors[cnt++] = entry->sector;
+    }
+  }
+  lock_release(&cache_lookup_lock);
+  return cnt;
+}
+
+/* Writes back those of the CNT SECTORS that are cached, dirty and
+   not logged, sorting SECTORS and writing consecutive ones
+   together.  Up to WRITE_BACK_DEPTH runs are submitted before
+   waiting for any of them, so the block layer can schedule them
+   together.  Only a sector that starts the first run in flight is
+   waited for: waiting for any other while holding the earlier ones
+   could deadlock with a thread that pins sectors in another order.
+   Instead, the runs in flight are completed first. */
+static void write_back(block_sector_t* sectors, size_t cnt) {
+  struct write_batch batches[WRITE_BACK_DEPTH];
+  struct semaphore done;
+  size_t pending = 0;
+  size_t i = 0, j, k;
+
+  sema_init(&done, 0);
+  qsort(sectors, cnt, sizeof *sectors, compare_sectors);
+  while (i < cnt || pending > 0) {
+    struct write_batch* wb = &batches[pending];
+    block_sector_t first = i < cnt ? sectors[i] : 0;
+    bool blocked = false;
+    size_t n = 0;
+
+    while (i < cnt && n < RUN_BATCH && sectors[i] == first + n) {
+      lock_acquire(&cache_lookup_lock);
+      struct cache_entry* entry = cache_lookup(sectors[i++]);
+      if (entry == NULL) {
+        lock_release(&cache_lookup_lock);
+        break;
+      }
+      if (n == 0 && pending == 0) {
+        cache_acquire(entry);
+      } else if (entry->waiters == 0 && lock_try_acquire(&entry->lck)) {
+        lock_release(&cache_lookup_lock);
+      } else {
+        lock_release(&cache_lookup_lock);
+        blocked = n == 0;
+        i--;
+        break;
+      }
+      if (entry->dirty_bit == 0 || entry->logged) {
+        entry_unlock(entry);
+        break;
+      }
+      wb->entries[n] = entry;
+      wb->bufs[n] = entry->data;
+      n++;
+    }
+    if (n > 0) {
+      wb->req.op = BLOCK_OP_WRITE;
+      wb->req.sector = first;
+      wb->req.cnt = n;
+      wb->req.buffers = wb->bufs;
+      wb->req.done = request_done;
+      wb->req.aux = &done;
+      block_submit(fs_device, &wb->req);
+      pending++;
+    }
+    if (pending > 0 && (pending == WRITE_BACK_DEPTH || blocked || i >= cnt)) {
+      for (j = 0; j < pending; j++)
+        sema_down(&done);
+      for (j = 0; j < pending; j++) {
+        for (k = 0; k < batches[j].req.cnt; k++) {
+          mark_clean(batches[j].entries[k]);
+          entry_unlock(batches[j].entries[k]);
+        }
+      }
+      pending = 0;
+    }
+  }
+}
+
+/* Completion function for requests the cache waits for on the
+   semaphore in AUX. */
+static void request_done(struct block_request* req) { sema_up(req->aux); }
+
+/* Writes back the dirty file data of the inode in sector OWNER,
+   leaving the rest of the cache as it is.  Metadata, which is
+   logged, is left to the journal.  Returns false if memory runs
+   out. */
+bool cache_sync(block_sector_t owner) {
+  struct list* lists[] = {&t1, &t2};
+  block_sector_t* sectors = malloc(cache_size * sizeof *sectors);
+  size_t cnt = 0;
+  size_t i;
+
+  if (sectors == NULL)
+    return false;
+  lock_acquire(&cache_lookup_lock);
+  for (i = 0; i < 2; i++) {
+    struct list_elem* e;
+    for (e = list_begin(lists[i]); e != list_end(lists[i]); e = list_next(e)) {
+      struct cache_entry* entry = list_entry(e, struct cache_entry, elem);
+      if (entry->owner == owner && entry->dirty_bit == 1 && !entry->logged && cnt < cache_size)
+        sectors[cnt++] = entry->sector;
+    }
+  }
+  lock_release(&cache_lookup_lock);
+  write_back(sectors, cnt);
+  free(sectors);
+  return true;
+}
+
+/* Orders block_sector_t values for qsort(). */
+static int compare_sectors(const void* a_, const void* b_) {
+  const block_sector_t* a = a_;
+  const block_sector_t* b = b_;
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Marks locked ENTRY dirty, waking the flusher if too much of the
+   cache is waiting to be written back. */
+static void mark_dirty(struct cache_entry* entry) {
+  enum intr_level old_level;
+
+  if (entry->dirty_bit == 1)
+    return;
+  entry->dirty_bit = 1;
+  old_level = intr_disable();
+  if (++dirty_cnt > DIRTY_HIGH && flusher_started && !flush_pending) {
+    flush_pending = true;
+    sema_up(&flush_sema);
+  }
+  intr_set_level(old_level);
+}
+
+/* Marks locked ENTRY clean after it has been written back. */
+static void mark_clean(struct cache_entry* entry) {
+  enum intr_level old_level;
+
+  if (entry->dirty_bit == 0)
+    return;
+  entry->dirty_bit = 0;
+  old_level = intr_disable();
+  dirty_cnt--;
+  intr_set_level(old_level);
+}
+
+/* Adds locked ENTRY to the running journal transaction. */
+static void mark_logged(struct cache_entry* entry) {
+  enum intr_level old_level;
+
+  if (entry->logged)
+    return;
+  entry->logged = true;
+  old_level = intr_disable();
+  logged_cnt++;
+  intr_set_level(old_level);
+}
+
+/* Takes locked ENTRY out of the journal transaction, after it has
+   been written home. */
+static void clear_logged(struct cache_entry* entry) {
+  enum intr_level old_level;
+
+  if (!entry->logged)
+    return;
+  entry->logged = false;
+  old_level = intr_disable();
+  logged_cnt--;
+  intr_set_level(old_level);
+}
+
+/* Hashes a cache entry by its sector number. */
+static unsigned cache_hash(const struct hash_elem* e, void* aux UNUSED) {
+  return hash_int(hash_entry(e, struct cache_entry, hash_elem)->sector);
+}
+
+/* Orders cache entries by sector number. */
+static bool cache_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED) {
+  return hash_entry(a, struct cache_entry, hash_elem)->sector <
+         hash_entry(b, struct cache_entry, hash_elem)->sector;
+}
+
+/* Hashes a ghost record by its sector number. */
+static unsigned ghost_hash(const struct hash_elem* e, void* aux UNUSED) {
+  return hash_int(hash_entry(e, struct cache_ghost, hash_elem)->sector);
+}
+
+/* Orders ghost records by sector number. */
+static bool ghost_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED) {
+  return hash_entry(a, struct cache_ghost, hash_elem)->sector <
+         hash_entry(b, struct cache_ghost, hash_elem)->sector;
+}
+
+/* Returns the cached entry for SEC, or NULL if SEC is not cached.
+   Must be called with cache_lookup_lock held. */
+static struct cache_entry* cache_lookup(block_sector_t sec) {
+  struct cache_entry key;
+  struct hash_elem* e;
+
+  key.sector = sec;
+  e = hash_find(&cache_index, &key.hash_elem);
+  return e != NULL ? hash_entry(e, struct cache_entry, hash_elem) : NULL;
+}
+
+/* Returns the ghost record for SEC, or NULL if there is none.
+   Must be called with cache_lookup_lock held. */
+static struct cache_ghost* ghost_lookup(block_sector_t sec) {
+  struct cache_ghost key;
+  struct hash_elem* e;
+
+  key.sector = sec;
+  e = hash_find(&ghost_index, &key.hash_elem);
+  return e != NULL ? hash_entry(e, struct cache_ghost, hash_elem) : NULL;
 }
 
 /* Read cache entry */
 void block_read_cached(struct block* b, block_sector_t sec, void* buffer, int offset, int size) {
-  struct cache_entry* cache = get_cache_entry(b, sec);
+  struct cache_entry* cache = get_cache_entry(b, sec, true);
   memcpy(buffer, cache->data + offset, size);
-  lock_release(&cache->lck);
+  entry_unlock(cache);
 }
 
 /* Write to cache entry */
 void block_write_cached(struct block* b, block_sector_t sec, void* buffer, int offset, int size) {
-  struct cache_entry* cache = get_cache_entry(b, sec);
+  struct cache_entry* cache = get_cache_entry(b, sec, size < BLOCK_SECTOR_SIZE);
   memcpy(cache->data + offset, buffer, size);
-  cache->dirty_bit = 1;
-  lock_release(&cache->lck);
+  mark_dirty(cache);
+  entry_unlock(cache);
+}
+
+/* Pins sector SEC of B in the cache and returns a pointer to its
+   BLOCK_SECTOR_SIZE-byte frame, so the caller can use the sector
+   in place instead of copying it.  The sector stays resident, and
+   other threads wanting it wait, until the caller passes the
+   frame to cache_unpin().  A thread must not pin a sector it
+   already has pinned. */
+void* cache_pin(struct block* b, block_sector_t sec, enum cache_mode mode) {
+  return get_cache_entry(b, sec, mode != CACHE_CREATE)->data;
+}
+
+/* Releases FRAME, which cache_pin() returned.  DIRTY says whether
+   the caller modified it, which requires CACHE_WRITE or
+   CACHE_CREATE mode. */
+void cache_unpin(void* frame, bool dirty) {
+  struct cache_entry* entry = frame_to_entry(frame);
+
+  ASSERT(lock_held_by_current_thread(&entry->lck));
+  if (dirty)
+    mark_dirty(entry);
+  entry_unlock(entry);
+}
+
+/* Adds the sector whose frame is FRAME, which the caller has
+   pinned and is about to unpin as dirty, to the running journal
+   transaction.  It is then not written back until the transaction
+   commits. */
+void cache_log(void* frame) {
+  struct cache_entry* entry = frame_to_entry(frame);
+
+  ASSERT(lock_held_by_current_thread(&entry->lck));
+  mark_logged(entry);
 }
 
-/* Get the cache entry. Move it to the front of the cache. Read from the disk if 
-the entry doesn't exist. */
-struct cache_entry* get_cache_entry(struct block* b, block_sector_t sec) {
+/* Records that the sector whose frame is FRAME, which the caller
+   has pinned and is about to unpin as dirty, holds file data of
+   the inode in sector OWNER, so that cache_sync() writes it. */
+void cache_own(void* frame, block_sector_t owner) {
+  struct cache_entry* entry = frame_to_entry(frame);
+
+  ASSERT(lock_held_by_current_thread(&entry->lck));
+  entry->owner = owner;
+}
+
+/* Records that the sector whose frame is FRAME, which the caller
+   has pinned and is about to unpin as dirty, is file data newly
+   mapped by metadata in the running journal transaction, so that
+   the transaction's commit writes it back first.  A crash then
+   never leaves committed metadata pointing at stale sectors. */
+void cache_order(void* frame) {
+  struct cache_entry* entry = frame_to_entry(frame);
+
+  ASSERT(lock_held_by_current_thread(&entry->lck));
+  entry->ordered = true;
+}
+
+/* Returns the number of sectors logged by the running journal
+   transaction. */
+size_t cache_logged_cnt(void) { return logged_cnt; }
+
+/* Stores the first MAX of the sectors logged by the running
+   journal transaction in SECTORS and returns how many there are
+   in all. */
+size_t cache_logged(block_sector_t* sectors, size_t max) {
+  struct list* lists[] = {&t1, &t2};
+  size_t cnt = 0;
+  size_t i;
+
   lock_acquire(&cache_lookup_lock);
-  struct list_elem* e;
+  for (i = 0; i < 2; i++) {
+    struct list_elem* e;
+    for (e = list_begin(lists[i]); e != list_end(lists[i]); e = list_next(e)) {
+      struct cache_entry* entry = list_entry(e, struct cache_entry, elem);
+      if (entry->logged && cnt++ < max)
+        sectors[cnt - 1] = entry->sector;
+    }
+  }
+  lock_release(&cache_lookup_lock);
+  return cnt;
+}
+
+/* Copies sector SEC of B into BUFFER, from its frame if it is
+   cached and from disk otherwise, without counting as an access:
+   neither the hit count nor the replacement policy sees it. */
+void cache_peek(struct block* b, block_sector_t sec, void* buffer) {
+  lock_acquire(&cache_lookup_lock);
+  struct cache_entry* entry = cache_lookup(sec);
+  if (entry == NULL) {
+    lock_release(&cache_lookup_lock);
+    block_read(b, sec, buffer);
+    return;
+  }
+  cache_acquire(entry);
+  memcpy(buffer, entry->data, BLOCK_SECTOR_SIZE);
+  entry_unlock(entry);
+}
+
+/* Records that logged sector SEC has been written home by a
+   journal commit, so that it is clean and may be written back and
+   evicted again. */
+void cache_checkpointed(block_sector_t sec) {
+  lock_acquire(&cache_lookup_lock);
+  struct cache_entry* entry = cache_lookup(sec);
+  if (entry == NULL) {
+    lock_release(&cache_lookup_lock);
+    return;
+  }
+  cache_acquire(entry);
+  if (entry->logged) {
+    clear_logged(entry);
+    mark_clean(entry);
+  }
+  entry_unlock(entry);
+}
+
+/* Returns the entry whose frame is FRAME. */
+static struct cache_entry* frame_to_entry(void* frame) {
+  size_t idx = ((char*)frame - frames) / BLOCK_SECTOR_SIZE;
+
+  ASSERT(idx <= cache_size);
+  ASSERT(entries[idx].data == frame);
+  return &entries[idx];
+}
+
+/* Get the cache entry and record the access with the replacement
+   policy.  On a miss, reads the sector from disk unless READ is
+   false, in which case the caller overwrites the whole frame. */
+struct cache_entry* get_cache_entry(struct block* b, block_sector_t sec, bool read) {
   struct cache_entry* entry;
-  for (e = list_begin(&cache); e != list_end(&cache); e = list_next(e)) {
-    entry = list_entry(e, struct cache_entry, elem);
-    if (entry->sector == sec) {
-      list_remove(e);
-      list_push_front(&cache, e);
-      lock_acquire(&entry->lck);
-      lock_release(&cache_lookup_lock);
-      hits++;
+
+  lock_acquire(&cache_lookup_lock);
+  while ((entry = cache_lookup(sec)) == NULL) {
+    entry = cache_load(b, sec, read);
+    if (entry != NULL)
       return entry;
+  }
+  cache_touch(entry);
+  cache_acquire(entry);
+  return entry;
+}
+
+/* Records a hit on resident ENTRY with the replacement policy.
+   Must be called with cache_lookup_lock held. */
+static void cache_touch(struct cache_entry* entry) {
+  list_remove(&entry->elem);
+  if (entry->prefetched) {
+    /* The first real access to a read-ahead sector counts as
+       its first touch, so streams stay in t1. */
+    entry->prefetched = false;
+  } else if (cache_policy == CACHE_ARC && entry->queue == &t1) {
+    /* Under ARC a second touch moves the sector to the frequency
+       list; under LRU it just becomes most recently used. */
+    t1_cnt--;
+    t2_cnt++;
+    entry->queue = &t2;
+  }
+  list_push_front(entry->queue, &entry->elem);
+  hits++;
+}
+
+/* Copies SIZE bytes into BUFFER from the run of consecutive
+   sectors of B that starts at sector START, beginning OFS bytes
+   into the run.  Cached sectors are copied from their frames.
+   Each stretch of uncached sectors, up to RUN_BATCH of them, is
+   read from disk with one vectored request. */
+void cache_read_run(struct block* b, block_sector_t start, off_t ofs, void* buffer, off_t size) {
+  uint8_t* dst = buffer;
+  block_sector_t sec = start + ofs / BLOCK_SECTOR_SIZE;
+
+  ofs %= BLOCK_SECTOR_SIZE;
+  while (size > 0) {
+    struct cache_entry* batch[RUN_BATCH];
+    void* bufs[RUN_BATCH];
+    size_t cnt = 0, i;
+
+    lock_acquire(&cache_lookup_lock);
+    struct cache_entry* entry = cache_lookup(sec);
+    if (entry != NULL) {
+      cache_touch(entry);
+      cache_acquire(entry);
+      batch[cnt++] = entry;
+    } else {
+      /* Claim this sector and the uncached ones after it that the
+         copy covers.  They stay locked until they have been read. */
+      size_t want = DIV_ROUND_UP(ofs + size, BLOCK_SECTOR_SIZE);
+      do {
+        batch[cnt] = cache_insert(b, sec + cnt, false);
+        if (batch[cnt] == NULL)
+          break;
+        bufs[cnt] = batch[cnt]->data;
+        cnt++;
+        /* Holding entries, claim more only if that cannot wait. */
+      } while (cnt < want && cnt < RUN_BATCH && cache_lookup(sec + cnt) == NULL && has_room());
+      lock_release(&cache_lookup_lock);
+      if (cnt == 0)
+        continue;
+      block_readv(b, sec, bufs, cnt);
+    }
+
+    for (i = 0; i < cnt; i++) {
+      off_t chunk = BLOCK_SECTOR_SIZE - ofs < size ? BLOCK_SECTOR_SIZE - ofs : size;
+      memcpy(dst, batch[i]->data + ofs, chunk);
+      entry_unlock(batch[i]);
+      dst += chunk;
+      size -= chunk;
+      ofs = 0;
+      sec++;
     }
   }
-  LRU_evict(b);
-  entry = (struct cache_entry*)malloc(sizeof(struct cache_entry));
+}
+
+/* Copies SIZE bytes from BUFFER into the run of consecutive
+   sectors of B that starts at sector START, beginning OFS bytes
+   into the run.  Sectors overwritten entirely are not read first;
+   the flusher writes the run back in vectored requests.  The run
+   belongs to the inode in sector OWNER.  If LOG is true, the
+   sectors are metadata and join the running journal transaction. */
+void cache_write_run(struct block* b, block_sector_t start, off_t ofs, const void* buffer,
+                     off_t size, block_sector_t owner, bool log) {
+  const uint8_t* src = buffer;
+  block_sector_t sec = start + ofs / BLOCK_SECTOR_SIZE;
+
+  ofs %= BLOCK_SECTOR_SIZE;
+  while (size > 0) {
+    off_t chunk = BLOCK_SECTOR_SIZE - ofs < size ? BLOCK_SECTOR_SIZE - ofs : size;
+    struct cache_entry* entry = get_cache_entry(b, sec, chunk < BLOCK_SECTOR_SIZE);
+    memcpy(entry->data + ofs, src, chunk);
+    entry->owner = owner;
+    if (log)
+      mark_logged(entry);
+    mark_dirty(entry);
+    entry_unlock(entry);
+    src += chunk;
+    size -= chunk;
+    ofs = 0;
+    sec++;
+  }
+}
+
+/* Brings those of the CNT sectors in SECTORS that are not cached
+   yet into the cache.  Their reads are all submitted before any is
+   waited for, so the block layer can merge neighbours and serve
+   them in one sweep.  Does not count as an access to the sectors.
+   CNT must not exceed CACHE_PREFETCH_MAX. */
+void cache_prefetch(struct block* b, const block_sector_t* sectors, size_t cnt) {
+  struct block_request reqs[CACHE_PREFETCH_MAX];
+  struct cache_entry* batch[CACHE_PREFETCH_MAX];
+  void* bufs[CACHE_PREFETCH_MAX];
+  struct semaphore done;
+  size_t n = 0, i;
+
+  ASSERT(cnt <= CACHE_PREFETCH_MAX);
+  sema_init(&done, 0);
+  for (i = 0; i < cnt; i++) {
+    lock_acquire(&cache_lookup_lock);
+    if (cache_lookup(sectors[i]) != NULL) {
+      lock_release(&cache_lookup_lock);
+      continue;
+    }
+    if (!has_room()) {
+      /* Read-ahead is not worth waiting for. */
+      lock_release(&cache_lookup_lock);
+      break;
+    }
+    batch[n] = cache_insert(b, sectors[i], true);
+    lock_release(&cache_lookup_lock);
+    if (batch[n] == NULL)
+      continue;
+    bufs[n] = batch[n]->data;
+    reqs[n].op = BLOCK_OP_READ;
+    reqs[n].sector = sectors[i];
+    reqs[n].cnt = 1;
+    reqs[n].buffers = &bufs[n];
+    reqs[n].done = request_done;
+    reqs[n].aux = &done;
+    block_submit(b, &reqs[n]);
+    n++;
+  }
+  for (i = 0; i < n; i++)
+    sema_down(&done);
+  for (i = 0; i < n; i++)
+    entry_unlock(batch[i]);
+}
+
+/* Locks ENTRY, which must be resident, and releases
+   cache_lookup_lock, which the caller must hold.  The entry cannot
+   be evicted while we wait for its lock. */
+static void cache_acquire(struct cache_entry* entry) {
+  enum intr_level old_level;
+
+  entry->waiters++;
+  lock_release(&cache_lookup_lock);
+  lock_acquire(&entry->lck);
+  old_level = intr_disable();
+  entry->waiters--;
+  intr_set_level(old_level);
+}
+
+/* Allocates an entry for SEC, which must not be cached, evicting
+   another entry if the cache is full, and reads SEC into it if
+   READ is true.
+   Must be called with cache_lookup_lock held, which it releases
+   before the disk read so that other sectors can be served
+   meanwhile; anyone else wanting SEC waits on the entry's lock.
+   Returns the entry with its lock held, or a null pointer, with
+   cache_lookup_lock still held, if cache_insert() gave up. */
+static struct cache_entry* cache_load(struct block* b, block_sector_t sec, bool read) {
+  struct cache_entry* entry = cache_insert(b, sec, false);
+
+  if (entry == NULL)
+    return NULL;
+  lock_release(&cache_lookup_lock);
+  if (read)
+    block_read(b, sec, entry->data);
+  return entry;
+}
+
+/* Allocates an entry for SEC, which must not be cached, evicting
+   another entry if the cache is full, and returns it locked and
+   indexed but without its data.  Must be called with
+   cache_lookup_lock held.
+   If every entry is busy, releases cache_lookup_lock until one is
+   unlocked, and does so too while writing back a dirty victim.
+   Returns a null pointer, to be retried, if SEC was cached or the
+   victim was wanted meanwhile.  A caller holding other entries
+   must check has_room() first, because the entries it holds may
+   be the busy ones. */
+static struct cache_entry* cache_insert(struct block* b, block_sector_t sec, bool prefetched) {
+  struct cache_entry* entry;
+  struct cache_entry* victim = NULL;
+  struct list* target = &t1;
+  bool in_b2 = false;
+  bool discard = false;
+
+  insert_waiters++;
+  while (!has_room()) {
+    cond_wait(&unpin_cond, &cache_lookup_lock);
+    if (cache_lookup(sec) != NULL) {
+      insert_waiters--;
+      return NULL;
+    }
+  }
+  insert_waiters--;
+
+  if (cache_policy == CACHE_ARC) {
+    struct cache_ghost* ghost = ghost_lookup(sec);
+    if (ghost != NULL && ghost->queue == &b1) {
+      /* Recency list was too small: grow its target. */
+      size_t delta = b1_cnt >= b2_cnt ? 1 : b2_cnt / b1_cnt;
+      arc_p = arc_p + delta < cache_size ? arc_p + delta : cache_size;
+      ghost_remove(ghost);
+      target = &t2;
+    } else if (ghost != NULL) {
+      /* Frequency list was too small: shrink t1's target. */
+      size_t delta = b2_cnt >= b1_cnt ? 1 : b1_cnt / b2_cnt;
+      arc_p = arc_p > delta ? arc_p - delta : 0;
+      ghost_remove(ghost);
+      target = &t2;
+      in_b2 = true;
+    } else if (t1_cnt + b1_cnt >= cache_size) {
+      /* Keep t1 and b1 together within the cache size. */
+      if (t1_cnt < cache_size)
+        ghost_drop_lru(&b1);
+      else
+        discard = true;
+    } else if (t1_cnt + t2_cnt + b1_cnt + b2_cnt >= 2 * cache_size) {
+      ghost_drop_lru(&b2);
+    }
+  }
+  if (t1_cnt + t2_cnt >= cache_size) {
+    victim = clean_victim(b, sec, in_b2);
+    if (victim == NULL)
+      return NULL;
+  }
+
+  ASSERT(!list_empty(&free_entries));
+  entry = list_entry(list_pop_front(&free_entries), struct cache_entry, elem);
   entry->dirty_bit = 0;
+  entry->logged = false;
+  entry->ordered = false;
+  entry->owner = 0;
   entry->sector = sec;
-  lock_init(&entry->lck);
+  entry->waiters = 0;
+  entry->prefetched = prefetched;
   lock_acquire(&entry->lck);
-  block_read(b, sec, entry->data);
-  list_push_front(&cache, &entry->elem);
-  lock_release(&cache_lookup_lock);
+  /* Index the new entry before evicting so that a full cache
+     keeps the same element count and the index never rehashes.
+     The spare entry makes this possible. */
+  hash_insert(&cache_index, &entry->hash_elem);
+  if (victim != NULL)
+    cache_replace(victim, discard);
+  entry->queue = target;
+  list_push_front(target, &entry->elem);
+  if (target == &t1)
+    t1_cnt++;
+  else
+    t2_cnt++;
   return entry;
 }
 
-/* Evict cache entry and flush it to disk */
-void LRU_evict(struct block* block) {
-  if (list_size(&cache) == MAXSIZE) {
-    /* ensure nobody reads/write on last entry */
-    while (!lock_try_acquire(&list_entry(list_rbegin(&cache), struct cache_entry, elem)->lck))
-      ;
-    struct list_elem* e = list_pop_back(&cache);
+/* Returns true if the cache has a free entry or one that
+   clean_victim() can pick.  Must be called with cache_lookup_lock
+   held; the answer then stays true until it is released. */
+static bool has_room(void) {
+  struct list* lists[] = {&t1, &t2};
+  size_t i;
+
+  if (t1_cnt + t2_cnt < cache_size)
+    return true;
+  for (i = 0; i < 2; i++) {
+    struct list_elem* e;
+    for (e = list_rbegin(lists[i]); e != list_rend(lists[i]); e = list_prev(e)) {
+      struct cache_entry* entry = list_entry(e, struct cache_entry, elem);
+      if (!entry->logged && entry->waiters == 0 && entry->lck.holder == NULL)
+        return true;
+    }
+  }
+  return false;
+}
+
+/* Unlocks ENTRY and wakes any thread waiting in cache_insert() for
+   room.  Must be called without cache_lookup_lock held. */
+static void entry_unlock(struct cache_entry* entry) {
+  lock_release(&entry->lck);
+  if (insert_waiters > 0) {
+    lock_acquire(&cache_lookup_lock);
+    cond_broadcast(&unpin_cond, &cache_lookup_lock);
+    lock_release(&cache_lookup_lock);
+  }
+}
+
+/* Picks the entry to evict for a miss on SEC and returns it
+   locked and clean.  Under ARC the victim comes from t1 or t2
+   depending on the adaptive target; IN_B2 is true if SEC was found
+   in b2.  Sectors logged by the running journal transaction are
+   never evicted: they may reach their home locations only after
+   the log.  journal_begin() keeps them to half the cache.
+   A dirty victim is written back with cache_lookup_lock released,
+   as a miss reads, while its own lock keeps it unchanged.  If
+   someone started waiting for the victim meanwhile, or cached SEC,
+   gives the victim up and returns a null pointer.  Must be called
+   with cache_lookup_lock held, after checking has_room(). */
+static struct cache_entry* clean_victim(struct block* block, block_sector_t sec, bool in_b2) {
+  struct cache_entry* entry;
+  bool from_t1 = t1_cnt > 0 && (t1_cnt > arc_p || (in_b2 && t1_cnt == arc_p));
+
+  if (cache_policy == CACHE_LRU)
+    from_t1 = true;
+  entry = pick_victim(from_t1 ? &t1 : &t2);
+  if (entry == NULL)
+    entry = pick_victim(from_t1 ? &t2 : &t1);
+  ASSERT(entry != NULL);
+  if (entry->dirty_bit == 0)
+    return entry;
+
+  lock_release(&cache_lookup_lock);
+  block_write(block, entry->sector, entry->data);
+  lock_acquire(&cache_lookup_lock);
+  mark_clean(entry);
+  if (entry->waiters == 0 && cache_lookup(sec) == NULL)
+    return entry;
+  lock_release(&entry->lck);
+  if (insert_waiters > 0)
+    cond_broadcast(&unpin_cond, &cache_lookup_lock);
+  return NULL;
+}
+
+/* Evicts ENTRY, which clean_victim() returned, remembering it in
+   the ghost list matching its queue under ARC unless DISCARD is
+   set. */
+static void cache_replace(struct cache_entry* entry, bool discard) {
+  ASSERT(entry->dirty_bit == 0 && !entry->logged);
+  list_remove(&entry->elem);
+  hash_delete(&cache_index, &entry->hash_elem);
+  if (entry->queue == &t1)
+    t1_cnt--;
+  else
+    t2_cnt--;
+  if (cache_policy == CACHE_ARC && !discard)
+    ghost_push(entry->queue == &t1 ? &b1 : &b2, entry->sector);
+  lock_release(&entry->lck);
+  entry_free(entry);
+}
+
+/* Returns ENTRY, which must be unlocked and out of the resident
+   lists and the index, to the free pool. */
+static void entry_free(struct cache_entry* entry) {
+  entry->queue = NULL;
+  list_push_front(&free_entries, &entry->elem);
+}
+
+/* Returns the least recently used entry of LIST that nobody is
+   using or waiting for, with its lock held, or NULL if every entry
+   is busy.  Logged entries count as busy. */
+static struct cache_entry* pick_victim(struct list* list) {
+  struct list_elem* e;
+  for (e = list_rbegin(list); e != list_rend(list); e = list_prev(e)) {
     struct cache_entry* entry = list_entry(e, struct cache_entry, elem);
-    if (entry->dirty_bit == 1)
-      block_write(block, entry->sector, entry->data);
-    free(entry);
+    if (!entry->logged && entry->waiters == 0 && lock_try_acquire(&entry->lck)) {
+      if (!entry->logged)
+        return entry;
+      lock_release(&entry->lck);
+    }
   }
+  return NULL;
+}
+
+/* Remembers SECTOR at the front of ghost list LIST. */
+static void ghost_push(struct list* list, block_sector_t sector) {
+  struct cache_ghost* ghost;
+
+  /* ARC keeps at most cache_size ghosts, but reclaim the oldest
+     just in case rather than go without. */
+  if (list_empty(&free_ghosts))
+    ghost_drop_lru(b1_cnt > b2_cnt ? &b1 : &b2);
+  ghost = list_entry(list_pop_front(&free_ghosts), struct cache_ghost, elem);
+  ghost->sector = sector;
+  ghost->queue = list;
+  list_push_front(list, &ghost->elem);
+  hash_insert(&ghost_index, &ghost->hash_elem);
+  if (list == &b1)
+    b1_cnt++;
+  else
+    b2_cnt++;
+}
+
+/* Forgets the oldest sector of ghost list LIST, if any. */
+static void ghost_drop_lru(struct list* list) {
+  if (!list_empty(list))
+    ghost_remove(list_entry(list_back(list), struct cache_ghost, elem));
+}
+
+/* Removes GHOST from its list and the ghost index and returns it
+   to the free pool. */
+static void ghost_remove(struct cache_ghost* ghost) {
+  list_remove(&ghost->elem);
+  hash_delete(&ghost_index, &ghost->hash_elem);
+  if (ghost->queue == &b1)
+    b1_cnt--;
+  else
+    b2_cnt--;
+  list_push_front(&free_ghosts, &ghost->elem);
 }
 
 /* Return the number of cache hits so far. Used for tests. */
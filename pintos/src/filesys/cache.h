@@ -5,20 +5,68 @@
 #include "filesys/off_t.h"
 #include "devices/block.h"
 #include <list.h>
+#include <hash.h>
 #include "threads/synch.h"
 
+/* Buffer cache replacement policies. */
+enum cache_policy {
+  CACHE_LRU, /* Strict least recently used. */
+  CACHE_ARC  /* Adaptive replacement cache, scan resistant. */
+};
+
+extern enum cache_policy cache_policy;
+
+/* How the caller of cache_pin() will use the sector. */
+enum cache_mode {
+  CACHE_READ,  /* Only reads the frame. */
+  CACHE_WRITE, /* Reads and modifies the frame. */
+  CACHE_CREATE /* Overwrites the whole frame; old contents are not read. */
+};
+
+/* Number of sectors the buffer cache holds, set with -cache-size.
+   Half of it must hold a journal transaction. */
+#define CACHE_DEFAULT_SIZE 256
+#define CACHE_MIN_SIZE 64
+extern size_t cache_size;
+
+/* Most sectors one call to cache_prefetch() reads. */
+#define CACHE_PREFETCH_MAX 16
+
 struct cache_entry {
-  struct list_elem elem;
+  struct list_elem elem;      /* Element in a resident or free list. */
+  struct hash_elem hash_elem; /* Element in the sector index. */
+  struct list* queue;         /* Resident list holding this entry. */
   int dirty_bit;
   block_sector_t sector;
   struct lock lck;
-  char data[512];
+  int waiters;                /* Threads about to lock LCK; pins the entry. */
+  bool prefetched;            /* Read ahead and not yet accessed? */
+  bool logged;                /* In the running journal transaction? */
+  bool ordered;               /* New data the running transaction maps? */
+  block_sector_t owner;       /* Inode whose file data this is, or 0. */
+  char* data;                 /* BLOCK_SECTOR_SIZE-byte frame. */
 };
 
 void block_read_cached(struct block* b, block_sector_t sec, void* buffer, int offset, int size);
 void block_write_cached(struct block* b, block_sector_t sec, void* buffer, int offset,
                         int size); /* Wrapper around block_write function that implements caching*/
+void* cache_pin(struct block* b, block_sector_t sec, enum cache_mode mode);
+void cache_unpin(void* frame, bool dirty);
+void cache_read_run(struct block* b, block_sector_t start, off_t ofs, void* buffer, off_t size);
+void cache_write_run(struct block* b, block_sector_t start, off_t ofs, const void* buffer,
+                     off_t size, block_sector_t owner, bool log);
+void cache_log(void* frame);
+void cache_own(void* frame, block_sector_t owner);
+void cache_order(void* frame);
+bool cache_sync(block_sector_t owner);
+void cache_write_ordered(void);
+size_t cache_logged_cnt(void);
+size_t cache_logged(block_sector_t* sectors, size_t max);
+void cache_checkpointed(block_sector_t sec);
+void cache_peek(struct block* b, block_sector_t sec, void* buffer);
+void cache_prefetch(struct block* b, const block_sector_t* sectors, size_t cnt);
 void cache_init();
+void cache_tick(int64_t ticks);
 int hit_rate();
 void flush_cache();
 
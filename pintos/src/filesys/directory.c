@@ -2,11 +2,125 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <hash.h>
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 
+/* A directory that grows past DIR_INDEX_MIN entry slots gets a
+   hash index: a separate file, named in the directory's inode,
+   that maps the hash of each name to the slot holding its entry.
+   The entries themselves stay where they were, so smaller
+   directories, and any without an index, are searched slot by
+   slot as before.  The index is not journaled: one written before
+   a crash is rebuilt before it is trusted again. */
+#define DIR_INDEX_MIN 32
+
+/* Identifies a directory hash index. */
+#define INDEX_MAGIC 0x44494458
+
+/* Fewest buckets an index has. */
+#define INDEX_MIN_BUCKETS 64
+
+/* Bucket values other than 1 + an entry slot number. */
+#define BUCKET_EMPTY 0            /* Ends a probe sequence. */
+#define BUCKET_DELETED UINT32_MAX /* Entry removed; keep probing. */
+
+/* Start of a hash index file, followed by its buckets: an
+   open-addressed table probed linearly from a name's hash.  It is
+   rebuilt before more than half the buckets are in use, so probes
+   stay short and always end at an empty bucket. */
+struct index_header {
+  unsigned magic;      /* INDEX_MAGIC. */
+  uint32_t bucket_cnt; /* Number of buckets, a power of 2. */
+  uint32_t used;       /* Buckets that are not BUCKET_EMPTY. */
+  uint32_t live;       /* Buckets that name an entry. */
+  uint32_t free_hint;  /* Every entry slot below this is in use. */
+  uint32_t generation; /* journal_generation() when built. */
+};
+
+/* A directory's hash index, open for one operation. */
+struct index {
+  struct inode* inode;      /* Index file. */
+  struct index_header h;    /* Copy of its header. */
+};
+
+/* Directory entry cache: the outcomes of recent lookups, keyed by
+   the directory searched and the name, including names that were
+   not found.  It is direct mapped, so a new outcome replaces
+   whatever was in its slot.  dir_add() and dir_remove() keep it up
+   to date, so a cached outcome is always current. */
+#define DCACHE_SIZE 512
+
+struct dcache_entry {
+  block_sector_t parent;  /* Directory's inode sector, or 0 if unused. */
+  block_sector_t sector;  /* Inode NAME refers to, or 0 if not found. */
+  char name[NAME_MAX + 1];
+};
+
+static struct dcache_entry dcache[DCACHE_SIZE];
+static struct lock dcache_lock; /* Protects dcache. */
+
+/* Initializes the directory entry cache. */
+void dir_init(void) { lock_init(&dcache_lock); }
+
+/* Returns the cache slot for NAME in directory PARENT, or a null
+   pointer if NAME is too long to be cached. */
+static struct dcache_entry* dcache_slot(block_sector_t parent, const char* name) {
+  if (strlen(name) > NAME_MAX)
+    return NULL;
+  return &dcache[(hash_int(parent) ^ hash_string(name)) % DCACHE_SIZE];
+}
+
+/* Looks up NAME in directory PARENT in the cache.  If the outcome
+   is cached, returns true and sets *SECTOR to the inode NAME
+   refers to, or to 0 if PARENT has no such name. */
+static bool dcache_lookup(block_sector_t parent, const char* name, block_sector_t* sector) {
+  struct dcache_entry* d = dcache_slot(parent, name);
+  bool hit = false;
+
+  if (d == NULL)
+    return false;
+  lock_acquire(&dcache_lock);
+  if (d->parent == parent && !strcmp(d->name, name)) {
+    *sector = d->sector;
+    hit = true;
+  }
+  lock_release(&dcache_lock);
+  return hit;
+}
+
+/* Records that NAME in directory PARENT refers to SECTOR, or to
+   nothing if SECTOR is 0. */
+static void dcache_set(block_sector_t parent, const char* name, block_sector_t sector) {
+  struct dcache_entry* d = dcache_slot(parent, name);
+
+  if (d == NULL)
+    return;
+  lock_acquire(&dcache_lock);
+  d->parent = parent;
+  d->sector = sector;
+  strlcpy(d->name, name, sizeof d->name);
+  lock_release(&dcache_lock);
+}
+
+/* Forgets every outcome cached for directory PARENT, which is
+   being removed, so that nothing is found in a new directory that
+   reuses its sector. */
+static void dcache_purge(block_sector_t parent) {
+  struct dcache_entry* d;
+
+  lock_acquire(&dcache_lock);
+  for (d = dcache; d < dcache + DCACHE_SIZE; d++)
+    if (d->parent == parent)
+      d->parent = 0;
+  lock_release(&dcache_lock);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool dir_create(block_sector_t sector, size_t entry_cnt) {
@@ -18,7 +132,6 @@ bool dir_create(block_sector_t sector, size_t entry_cnt) {
 struct dir* dir_open(struct inode* inode) {
   struct dir* dir = calloc(1, sizeof *dir);
   if (inode != NULL && dir != NULL && !inode->removed) {
-    lock_init(&inode->dir_lock);
     dir->inode = inode;
     dir->pos = 0;
     return dir;
@@ -54,6 +167,182 @@ struct inode* dir_get_inode(struct dir* dir) {
   return dir->inode;
 }
 
+/* Reads entry slot SLOT of DIR into *E.
+   Returns false if SLOT is past the end of DIR. */
+static bool read_entry(const struct dir* dir, uint32_t slot, struct dir_entry* e) {
+  return inode_read_at(dir->inode, e, sizeof *e, slot * sizeof *e) == sizeof *e;
+}
+
+/* Reads bucket I of index IX into *VALUE. */
+static bool read_bucket(struct index* ix, uint32_t i, uint32_t* value) {
+  off_t ofs = sizeof ix->h + i * sizeof *value;
+  return inode_read_at(ix->inode, value, sizeof *value, ofs) == sizeof *value;
+}
+
+/* Writes VALUE to bucket I of index IX. */
+static bool write_bucket(struct index* ix, uint32_t i, uint32_t value) {
+  off_t ofs = sizeof ix->h + i * sizeof value;
+  return inode_write_at(ix->inode, &value, sizeof value, ofs) == sizeof value;
+}
+
+/* Writes back the header of index IX. */
+static bool write_header(struct index* ix) {
+  return inode_write_at(ix->inode, &ix->h, sizeof ix->h, 0) == sizeof ix->h;
+}
+
+/* Adds entry slot SLOT, whose name is NAME, to index IX.  The
+   caller must write back the header. */
+static bool index_insert(struct index* ix, const char* name, uint32_t slot) {
+  uint32_t mask = ix->h.bucket_cnt - 1;
+  uint32_t i = hash_string(name) & mask;
+  uint32_t n, value;
+
+  for (n = 0; n < ix->h.bucket_cnt; n++, i = (i + 1) & mask) {
+    if (!read_bucket(ix, i, &value))
+      return false;
+    if (value == BUCKET_EMPTY || value == BUCKET_DELETED) {
+      if (value == BUCKET_EMPTY)
+        ix->h.used++;
+      ix->h.live++;
+      return write_bucket(ix, i, slot + 1);
+    }
+  }
+  return false;
+}
+
+/* Rebuilds index IX from the entries of DIR, with enough buckets
+   that at most a quarter of them are in use. */
+static bool index_build(const struct dir* dir, struct index* ix) {
+  static const uint32_t empty[BLOCK_SECTOR_SIZE / sizeof(uint32_t)];
+  struct dir_entry e;
+  uint32_t slot, live, cnt, i;
+
+  live = 0;
+  ix->h.free_hint = UINT32_MAX;
+  for (slot = 0; read_entry(dir, slot, &e); slot++)
+    if (e.in_use)
+      live++;
+    else if (ix->h.free_hint == UINT32_MAX)
+      ix->h.free_hint = slot;
+  if (ix->h.free_hint == UINT32_MAX)
+    ix->h.free_hint = slot;
+
+  for (cnt = INDEX_MIN_BUCKETS; cnt < 4 * (live + 1); cnt *= 2)
+    continue;
+  ix->h.magic = INDEX_MAGIC;
+  ix->h.generation = journal_generation();
+  ix->h.bucket_cnt = cnt;
+  ix->h.used = ix->h.live = 0;
+
+  for (i = 0; i < cnt; i += sizeof empty / sizeof *empty) {
+    off_t size = cnt - i < sizeof empty / sizeof *empty ? (cnt - i) * sizeof *empty : sizeof empty;
+    if (inode_write_at(ix->inode, empty, size, sizeof ix->h + i * sizeof *empty) != size)
+      return false;
+  }
+  for (slot = 0; read_entry(dir, slot, &e); slot++)
+    if (e.in_use && !index_insert(ix, e.name, slot))
+      return false;
+  return write_header(ix);
+}
+
+/* Deletes index IX of DIR, which could not be kept up to date.
+   DIR is searched slot by slot from then on. */
+static void index_drop(const struct dir* dir, struct index* ix) {
+  inode_set_index(dir->inode, 0);
+  inode_remove(ix->inode);
+}
+
+/* Opens DIR's hash index into *IX.
+   Returns false if DIR has no usable index.  An index that was
+   never finished, or that may have missed changes to DIR before a
+   crash, is rebuilt if REPAIR is true and otherwise not used. */
+static bool index_open(const struct dir* dir, struct index* ix, bool repair) {
+  block_sector_t sector = inode_get_index(dir->inode);
+
+  if (sector == 0 || (ix->inode = inode_open(sector)) == NULL)
+    return false;
+  if (inode_read_at(ix->inode, &ix->h, sizeof ix->h, 0) == sizeof ix->h &&
+      ix->h.magic == INDEX_MAGIC && ix->h.generation == journal_generation())
+    return true;
+  if (!repair) {
+    inode_close(ix->inode);
+    return false;
+  }
+
+  /* Its entries are still in DIR. */
+  if (index_build(dir, ix))
+    return true;
+  index_drop(dir, ix);
+  inode_close(ix->inode);
+  return false;
+}
+
+/* Gives DIR a hash index of its current entries and opens it
+   into *IX. */
+static bool index_create(const struct dir* dir, struct index* ix) {
+  block_sector_t sector;
+
+  if (!free_map_allocate_near(inode_get_inumber(dir->inode) + 1, 1, &sector))
+    return false;
+  if (!inode_create(sector, 0, 0) || (ix->inode = inode_open(sector)) == NULL) {
+    free_map_release(sector, 1);
+    return false;
+  }
+  if (!index_build(dir, ix)) {
+    inode_remove(ix->inode);
+    inode_close(ix->inode);
+    return false;
+  }
+  inode_set_index(dir->inode, sector);
+  return true;
+}
+
+/* Searches index IX of DIR for NAME.  On success, returns true
+   and sets *EP to the entry and *SLOTP to its slot number. */
+static bool index_lookup(const struct dir* dir, struct index* ix, const char* name,
+                         struct dir_entry* ep, uint32_t* slotp) {
+  uint32_t mask = ix->h.bucket_cnt - 1;
+  uint32_t i = hash_string(name) & mask;
+  uint32_t n, value;
+
+  for (n = 0; n < ix->h.bucket_cnt; n++, i = (i + 1) & mask) {
+    if (!read_bucket(ix, i, &value) || value == BUCKET_EMPTY)
+      break;
+    if (value != BUCKET_DELETED && read_entry(dir, value - 1, ep) && ep->in_use &&
+        !strcmp(name, ep->name)) {
+      *slotp = value - 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Removes entry slot SLOT, named NAME, from DIR's index, if it
+   has one.  A bucket left behind by a failure here is harmless,
+   since lookups check the entry it names. */
+static void index_remove(const struct dir* dir, const char* name, uint32_t slot) {
+  struct index ix;
+  uint32_t mask, i, n, value;
+
+  if (!index_open(dir, &ix, true))
+    return;
+  mask = ix.h.bucket_cnt - 1;
+  i = hash_string(name) & mask;
+  for (n = 0; n < ix.h.bucket_cnt; n++, i = (i + 1) & mask) {
+    if (!read_bucket(&ix, i, &value) || value == BUCKET_EMPTY)
+      break;
+    if (value == slot + 1) {
+      if (write_bucket(&ix, i, BUCKET_DELETED))
+        ix.h.live--;
+      if (slot < ix.h.free_hint)
+        ix.h.free_hint = slot;
+      write_header(&ix);
+      break;
+    }
+  }
+  inode_close(ix.inode);
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -61,11 +350,25 @@ struct inode* dir_get_inode(struct dir* dir) {
    otherwise, returns false and ignores EP and OFSP. */
 static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep, off_t* ofsp) {
   struct dir_entry e;
+  struct index ix;
   size_t ofs;
 
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
+  if (index_open(dir, &ix, false)) {
+    uint32_t slot;
+    bool found = index_lookup(dir, &ix, name, &e, &slot);
+    inode_close(ix.inode);
+    if (found) {
+      if (ep != NULL)
+        *ep = e;
+      if (ofsp != NULL)
+        *ofsp = slot * sizeof e;
+    }
+    return found;
+  }
+
   for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
     if (e.in_use && !strcmp(name, e.name)) {
       if (ep != NULL)
@@ -83,14 +386,24 @@ static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep
    a null pointer.  The caller must close *INODE. */
 bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode) {
   struct dir_entry e;
+  block_sector_t parent, sector;
 
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
-  if (lookup(dir, name, &e, NULL))
-    *inode = inode_open(e.inode_sector);
-  else
-    *inode = NULL;
+  parent = inode_get_inumber(dir->inode);
+  if (dcache_lookup(parent, name, &sector)) {
+    *inode = sector != 0 ? inode_open(sector) : NULL;
+    return *inode != NULL;
+  }
+
+  /* Cache the outcome under the directory lock, so that it cannot
+     be overtaken by a change to DIR. */
+  lock_acquire(&dir->inode->dir_lock);
+  sector = lookup(dir, name, &e, NULL) ? e.inode_sector : 0;
+  dcache_set(parent, name, sector);
+  *inode = sector != 0 ? inode_open(sector) : NULL;
+  lock_release(&dir->inode->dir_lock);
 
   return *inode != NULL;
 }
@@ -100,10 +413,12 @@ bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode) {
    INODE_SECTOR.
    Returns true if successful, false on failure.
    Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   error occurs.  The caller must hold DIR's dir_lock. */
 bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector, int is_dir) {
   struct dir_entry e;
-  off_t ofs;
+  struct index ix;
+  bool indexed;
+  uint32_t slot;
   bool success = false;
 
   ASSERT(dir != NULL);
@@ -117,30 +432,54 @@ bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector, int
   if (lookup(dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
+  /* Index DIR once it is large enough to be worth it. */
+  indexed = index_open(dir, &ix, true) ||
+            (inode_length(dir->inode) >= DIR_INDEX_MIN * (off_t)sizeof e && index_create(dir, &ix));
+
+  /* Set SLOT to a free slot.  If there are no free slots, then it
+     will be set to the current end-of-file.  An index knows where
+     the free slots start.
 
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
+  for (slot = indexed ? ix.h.free_hint : 0; read_entry(dir, slot, &e); slot++)
     if (!e.in_use)
       break;
 
   /* Write slot. */
   e.in_use = true;
+  e.is_dir = is_dir != 0;
   strlcpy(e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
-   
+  success = inode_write_at(dir->inode, &e, sizeof e, slot * sizeof e) == sizeof e;
+  if (success)
+    dcache_set(inode_get_inumber(dir->inode), name, inode_sector);
+
+  /* Index the new entry, rebuilding the index first if it is
+     getting full.  An index that cannot be updated is dropped. */
+  if (indexed) {
+    if (success) {
+      bool indexed_entry;
+      ix.h.free_hint = slot + 1;
+      if ((ix.h.used + 1) * 2 > ix.h.bucket_cnt)
+        indexed_entry = index_build(dir, &ix);
+      else
+        indexed_entry = index_insert(&ix, name, slot) && write_header(&ix);
+      if (!indexed_entry)
+        index_drop(dir, &ix);
+    }
+    inode_close(ix.inode);
+  }
+
 done:
   return success;
 }
 
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs only if there is no file with the given NAME.
+   The caller must hold DIR's dir_lock. */
 bool dir_remove(struct dir* dir, const char* name) {
   struct dir_entry e;
   struct inode* inode = NULL;
@@ -159,25 +498,24 @@ bool dir_remove(struct dir* dir, const char* name) {
   if (inode == NULL)
     goto done;
 
-  struct inode_disk *ind_disk = (struct inode_disk*) malloc(sizeof(struct inode_disk));
-  block_read_cached(fs_device, inode->sector, ind_disk, 0, sizeof(struct inode_disk));
-  
   /* Check if the only entries in directory are "." and "..". If yes we can delete it. */
-  if (ind_disk->is_dir) {
+  if (inode_is_dir(inode)) {
     struct dir *dir_delete = dir_open(inode);
     char d_name[NAME_MAX + 1];
     while (dir_readdir(dir_delete, d_name)) {
       if (d_name[0] != '.') {
         dir_close(dir_delete);
-        free(ind_disk);
         return false;
       }
     } 
   }
-  free(ind_disk);
   e.in_use = false;
   if (inode_write_at(dir->inode, &e, sizeof e, ofs) != sizeof e)
     goto done;
+  index_remove(dir, name, ofs / sizeof e);
+  dcache_set(inode_get_inumber(dir->inode), name, 0);
+  if (inode_is_dir(inode))
+    dcache_purge(inode_get_inumber(inode));
 
   /* Remove inode. */
   inode_remove(inode);
@@ -206,6 +544,34 @@ bool dir_readdir(struct dir* dir, char name[NAME_MAX + 1]) {
   return false;
 }
 
+/* Reads entries of DIR, from its current position, into ENTRIES
+   until CNT have been stored or DIR runs out.  Skips "." and "..",
+   as dir_readdir() does, and reads a sector's worth of entries at
+   a time.  Returns the number of entries stored. */
+size_t dir_readdir_batch(struct dir* dir, struct dirent* entries, size_t cnt) {
+  struct dir_entry buf[BLOCK_SECTOR_SIZE / sizeof(struct dir_entry)];
+  size_t stored = 0;
+
+  while (stored < cnt) {
+    size_t buf_cnt = inode_read_at(dir->inode, buf, sizeof buf, dir->pos) / sizeof *buf;
+    size_t i;
+
+    if (buf_cnt == 0)
+      break;
+    for (i = 0; i < buf_cnt && stored < cnt; i++) {
+      struct dir_entry* e = &buf[i];
+      dir->pos += sizeof *e;
+      if (!e->in_use || !strcmp(e->name, ".") || !strcmp(e->name, ".."))
+        continue;
+      entries[stored].inumber = e->inode_sector;
+      entries[stored].is_dir = e->is_dir;
+      strlcpy(entries[stored].name, e->name, sizeof entries[stored].name);
+      stored++;
+    }
+  }
+  return stored;
+}
+
 /* Handles chdir syscall 
  * @dir, name of the new directory
  */
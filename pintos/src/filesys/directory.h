@@ -25,10 +25,21 @@ struct dir_entry {
   block_sector_t inode_sector; /* Sector number of header. */
   char name[NAME_MAX + 1];     /* Null terminated file name. */
   bool in_use;                 /* In use or free? */
+  bool is_dir;                 /* Names a directory? */
+};
+
+/* A directory entry as returned to user programs by getdents().
+   Must match struct dirent in lib/user/syscall.h. */
+struct dirent {
+  int inumber;             /* Sector number of the entry's inode. */
+  bool is_dir;             /* Names a directory? */
+  char name[NAME_MAX + 1]; /* Null terminated file name. */
 };
 
 bool filesys_chdir(const char *dir);
 
+void dir_init(void);
+
 /* Opening and closing directories. */
 bool dir_create(block_sector_t sector, size_t entry_cnt);
 struct dir* dir_open(struct inode* inode);
@@ -42,5 +53,6 @@ bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode);
 bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector, int is_dir);
 bool dir_remove(struct dir* dir, const char* name);
 bool dir_readdir(struct dir* dir, char name[NAME_MAX + 1]);
+size_t dir_readdir_batch(struct dir* dir, struct dirent* entries, size_t cnt);
 
 #endif /* filesys/directory.h */
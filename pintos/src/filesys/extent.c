@@ -0,0 +1,407 @@
+#include "filesys/extent.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+
+/* Identifies an extent tree block. */
+#define EXTENT_MAGIC 0x45585442
+
+/* Entries that fit in a tree block. */
+#define EXTENT_NODE_CNT 42
+
+/* Most levels of tree blocks below the root, far more than any
+   file that fits on a Pintos disk needs. */
+#define EXTENT_MAX_DEPTH 8
+
+/* An interior or leaf node of an extent tree, below the root.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct extent_block {
+  struct extent_header hdr;
+  unsigned magic;
+  struct extent e[EXTENT_NODE_CNT];
+};
+
+/* Tree blocks allocated for an insertion before it changes the
+   tree, so that it cannot fail halfway through. */
+struct spares {
+  block_sector_t sectors[EXTENT_MAX_DEPTH + 2];
+  size_t cnt;
+};
+
+static int node_find(const struct extent*, size_t cnt, uint32_t logical);
+static size_t splits_needed(const struct extent_root*, uint32_t logical);
+static block_sector_t take_spare(struct spares*);
+static bool node_insert(struct extent_header*, struct extent*, size_t max,
+                        const struct extent*, struct extent* split, struct spares*);
+static bool node_mark_written(struct extent_header*, struct extent*, uint32_t logical);
+static void node_truncate(struct extent_header*, struct extent*, uint32_t sectors);
+static void subtree_free(block_sector_t);
+static struct extent_block* block_pin(block_sector_t, enum cache_mode);
+static void block_unpin(struct extent_block*, bool dirty);
+
+/* Finds the extent that maps file sector LOGICAL and stores it in
+   *EXT.  Returns false if LOGICAL is not mapped. */
+bool extent_lookup(const struct extent_root* root, uint32_t logical, struct extent* ext) {
+  const struct extent_header* hdr = &root->hdr;
+  const struct extent* e = root->e;
+  struct extent_block* block = NULL;
+  bool found = false;
+
+  for (;;) {
+    int i = node_find(e, hdr->cnt, logical);
+    if (i < 0)
+      break;
+    if (hdr->depth == 0) {
+      if (logical - e[i].logical < e[i].length) {
+        *ext = e[i];
+        found = true;
+      }
+      break;
+    }
+
+    /* Descend, holding one node at a time. */
+    block_sector_t child = e[i].start;
+    if (block != NULL)
+      cache_unpin(block, false);
+    block = block_pin(child, CACHE_READ);
+    hdr = &block->hdr;
+    e = block->e;
+  }
+  if (block != NULL)
+    cache_unpin(block, false);
+  return found;
+}
+
+/* Stores the extent that maps the highest file sector in *EXT.
+   Returns false if the tree is empty. */
+bool extent_last(const struct extent_root* root, struct extent* ext) {
+  const struct extent_header* hdr = &root->hdr;
+  const struct extent* e = root->e;
+  struct extent_block* block = NULL;
+  bool found = false;
+
+  while (hdr->cnt > 0) {
+    if (hdr->depth == 0) {
+      *ext = e[hdr->cnt - 1];
+      found = true;
+      break;
+    }
+    block_sector_t child = e[hdr->cnt - 1].start;
+    if (block != NULL)
+      cache_unpin(block, false);
+    block = block_pin(child, CACHE_READ);
+    hdr = &block->hdr;
+    e = block->e;
+  }
+  if (block != NULL)
+    cache_unpin(block, false);
+  return found;
+}
+
+/* Maps file sectors LOGICAL through LOGICAL + CNT - 1, which must
+   not be mapped yet, to disk sectors START onward, as unwritten
+   if UNWRITTEN is true.  Extends the preceding extent instead if
+   the run continues it on disk and that keeps its unwritten
+   sectors at its end.  Returns false if a tree block could not be
+   allocated, in which case the tree is unchanged. */
+bool extent_insert(struct extent_root* root, uint32_t logical, block_sector_t start, size_t cnt,
+                   bool unwritten) {
+  struct extent ext, split;
+  struct spares spares;
+  size_t need = splits_needed(root, logical);
+
+  ASSERT(cnt > 0 && cnt <= EXTENT_MAX_LENGTH);
+  ext.logical = logical;
+  ext.start = start;
+  ext.length = cnt;
+  ext.unwritten = unwritten ? cnt : 0;
+
+  /* Get every block that splits may need first, so that failure
+     leaves the tree untouched. */
+  for (spares.cnt = 0; spares.cnt < need; spares.cnt++) {
+    if (!free_map_allocate(1, &spares.sectors[spares.cnt])) {
+      while (spares.cnt > 0)
+        free_map_release(spares.sectors[--spares.cnt], 1);
+      return false;
+    }
+  }
+
+  if (node_insert(&root->hdr, root->e, EXTENT_ROOT_CNT, &ext, &split, &spares)) {
+    /* The root split: move what stayed in it down into a spare
+       block and make the root index the two halves, growing the
+       tree by one level. */
+    block_sector_t spare = take_spare(&spares);
+    struct extent_block* left = block_pin(spare, CACHE_CREATE);
+    memset(left, 0, sizeof *left);
+    left->magic = EXTENT_MAGIC;
+    left->hdr = root->hdr;
+    memcpy(left->e, root->e, root->hdr.cnt * sizeof *root->e);
+    root->e[0].logical = left->e[0].logical;
+    root->e[0].start = spare;
+    root->e[0].length = 0;
+    root->e[0].unwritten = 0;
+    root->e[1] = split;
+    root->hdr.cnt = 2;
+    root->hdr.depth++;
+    block_unpin(left, true);
+  }
+  while (spares.cnt > 0)
+    free_map_release(spares.sectors[--spares.cnt], 1);
+  return true;
+}
+
+/* Marks file sector LOGICAL, and every sector before it in the
+   same extent, as written, so that they read back what is on
+   disk.  Returns false if LOGICAL is not mapped. */
+bool extent_mark_written(struct extent_root* root, uint32_t logical) {
+  return node_mark_written(&root->hdr, root->e, logical);
+}
+
+/* Unmaps and frees every file sector numbered SECTORS or higher,
+   along with tree blocks that no longer map anything. */
+void extent_truncate(struct extent_root* root, uint32_t sectors) {
+  node_truncate(&root->hdr, root->e, sectors);
+  if (root->hdr.cnt == 0)
+    root->hdr.depth = 0;
+}
+
+/* Returns the index of the last of the CNT entries in E whose
+   logical sector is at most LOGICAL, or -1 if there is none. */
+static int node_find(const struct extent* e, size_t cnt, uint32_t logical) {
+  int lo = 0, hi = (int)cnt - 1;
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (e[mid].logical <= logical)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+  return hi;
+}
+
+/* Returns how many tree blocks inserting an extent at file sector
+   LOGICAL may need: one for each node that a split starting at the
+   leaf would reach, that is, for each of the full nodes ending the
+   path from the root to the leaf, plus one more if the root is
+   among them, because a root split also moves the root's entries
+   down into a new block. */
+static size_t splits_needed(const struct extent_root* root, uint32_t logical) {
+  const struct extent_header* hdr = &root->hdr;
+  const struct extent* e = root->e;
+  struct extent_block* block = NULL;
+  bool full[EXTENT_MAX_DEPTH + 1];
+  size_t level = 0, need = 0;
+
+  full[level++] = hdr->cnt == EXTENT_ROOT_CNT;
+  while (hdr->depth > 0) {
+    int i = node_find(e, hdr->cnt, logical);
+    block_sector_t child = e[i < 0 ? 0 : i].start;
+
+    if (block != NULL)
+      cache_unpin(block, false);
+    block = block_pin(child, CACHE_READ);
+    hdr = &block->hdr;
+    e = block->e;
+    ASSERT(level <= EXTENT_MAX_DEPTH);
+    full[level++] = hdr->cnt == EXTENT_NODE_CNT;
+  }
+  if (block != NULL)
+    cache_unpin(block, false);
+
+  while (level > 0 && full[level - 1]) {
+    level--;
+    need++;
+  }
+  if (level == 0)
+    need++;
+  return need;
+}
+
+/* Removes and returns one of the blocks in SPARES, of which there
+   must be at least one left. */
+static block_sector_t take_spare(struct spares* spares) {
+  ASSERT(spares->cnt > 0);
+  return spares->sectors[--spares->cnt];
+}
+
+/* Inserts EXT into the node with header HDR and entries E, which
+   has room for MAX entries, or into the right subtree below it,
+   taking any block a split needs from SPARES.  Returns true if the
+   node had to split, after storing an index entry for the new
+   right sibling in *SPLIT for the caller to add to the parent. */
+static bool node_insert(struct extent_header* hdr, struct extent* e, size_t max,
+                        const struct extent* ext, struct extent* split,
+                        struct spares* spares) {
+  struct extent entry = *ext;
+  int i = node_find(e, hdr->cnt, ext->logical);
+  size_t pos;
+
+  if (hdr->depth > 0) {
+    struct extent_block* child;
+    bool child_split;
+
+    /* Below every key: the first child takes it. */
+    if (i < 0) {
+      i = 0;
+      e[0].logical = ext->logical;
+    }
+    child = block_pin(e[i].start, CACHE_WRITE);
+    child_split = node_insert(&child->hdr, child->e, EXTENT_NODE_CNT, ext, &entry, spares);
+    block_unpin(child, true);
+    if (!child_split)
+      return false;
+    pos = i + 1;
+  } else {
+    /* Extend the preceding extent if the run continues it.  Only
+       an unwritten run may follow unwritten sectors. */
+    if (i >= 0 && e[i].logical + e[i].length == ext->logical &&
+        e[i].start + e[i].length == ext->start &&
+        e[i].length + ext->length <= EXTENT_MAX_LENGTH &&
+        (e[i].unwritten == 0 || ext->unwritten == ext->length)) {
+      e[i].length += ext->length;
+      e[i].unwritten += ext->unwritten;
+      return false;
+    }
+    pos = i + 1;
+  }
+
+  if (hdr->cnt < max) {
+    memmove(e + pos + 1, e + pos, (hdr->cnt - pos) * sizeof *e);
+    e[pos] = entry;
+    hdr->cnt++;
+    return false;
+  }
+
+  /* Full: split the entries, plus the new one, between this node
+     and a new right sibling.  Files mostly grow at the end, so an
+     append starts the sibling with just the new entry, leaving this
+     node full; otherwise the entries are divided evenly. */
+  struct extent all[EXTENT_NODE_CNT + 1];
+  struct extent_block* right;
+  block_sector_t sector = take_spare(spares);
+  size_t total = hdr->cnt + 1;
+  size_t keep = pos == hdr->cnt ? hdr->cnt : total / 2;
+
+  memcpy(all, e, pos * sizeof *e);
+  all[pos] = entry;
+  memcpy(all + pos + 1, e + pos, (hdr->cnt - pos) * sizeof *e);
+
+  right = block_pin(sector, CACHE_CREATE);
+  memset(right, 0, sizeof *right);
+  right->magic = EXTENT_MAGIC;
+  right->hdr.depth = hdr->depth;
+  right->hdr.cnt = total - keep;
+  memcpy(right->e, all + keep, (total - keep) * sizeof *e);
+  memcpy(e, all, keep * sizeof *e);
+  hdr->cnt = keep;
+
+  split->logical = right->e[0].logical;
+  split->start = sector;
+  split->length = 0;
+  split->unwritten = 0;
+  block_unpin(right, true);
+  return true;
+}
+
+/* Marks file sector LOGICAL written in the subtree rooted at the
+   node with header HDR and entries E, along with the sectors
+   before it in its extent.  Returns false if LOGICAL is not
+   mapped there. */
+static bool node_mark_written(struct extent_header* hdr, struct extent* e, uint32_t logical) {
+  int i = node_find(e, hdr->cnt, logical);
+  uint32_t end;
+
+  if (i < 0)
+    return false;
+  if (hdr->depth > 0) {
+    struct extent_block* child = block_pin(e[i].start, CACHE_WRITE);
+    bool found = node_mark_written(&child->hdr, child->e, logical);
+    block_unpin(child, found);
+    return found;
+  }
+
+  end = e[i].logical + e[i].length;
+  if (logical >= end)
+    return false;
+  if (e[i].unwritten > end - logical - 1)
+    e[i].unwritten = end - logical - 1;
+  return true;
+}
+
+/* Frees what the node with header HDR and entries E maps at or
+   beyond file sector SECTORS, working back from its last entry. */
+static void node_truncate(struct extent_header* hdr, struct extent* e, uint32_t sectors) {
+  while (hdr->cnt > 0) {
+    struct extent* last = &e[hdr->cnt - 1];
+
+    if (hdr->depth == 0) {
+      if (last->logical >= sectors) {
+        free_map_release(last->start, last->length);
+        hdr->cnt--;
+        continue;
+      }
+      if (last->logical + last->length > sectors) {
+        uint16_t keep = sectors - last->logical;
+        uint16_t drop = last->length - keep;
+        free_map_release(last->start + keep, drop);
+        last->length = keep;
+        last->unwritten = last->unwritten > drop ? last->unwritten - drop : 0;
+      }
+      break;
+    }
+
+    /* A subtree wholly past the end is freed as it is, rather than
+       emptied, so that it does not join the journal transaction. */
+    if (last->logical >= sectors) {
+      subtree_free(last->start);
+      hdr->cnt--;
+      continue;
+    }
+
+    struct extent_block* child = block_pin(last->start, CACHE_WRITE);
+    bool empty;
+    node_truncate(&child->hdr, child->e, sectors);
+    empty = child->hdr.cnt == 0;
+    block_unpin(child, true);
+    if (!empty)
+      break;
+    free_map_release(last->start, 1);
+    hdr->cnt--;
+  }
+}
+
+/* Frees tree block SECTOR along with everything its subtree maps.
+   The blocks are only read, so however large the subtree, freeing
+   it logs nothing. */
+static void subtree_free(block_sector_t sector) {
+  struct extent_block* block = block_pin(sector, CACHE_READ);
+  size_t i;
+
+  for (i = 0; i < block->hdr.cnt; i++) {
+    if (block->hdr.depth == 0)
+      free_map_release(block->e[i].start, block->e[i].length);
+    else
+      subtree_free(block->e[i].start);
+  }
+  cache_unpin(block, false);
+  free_map_release(sector, 1);
+}
+
+/* Pins tree block SECTOR in MODE. */
+static struct extent_block* block_pin(block_sector_t sector, enum cache_mode mode) {
+  struct extent_block* block = cache_pin(fs_device, sector, mode);
+  ASSERT(sizeof *block == BLOCK_SECTOR_SIZE);
+  ASSERT(mode == CACHE_CREATE || block->magic == EXTENT_MAGIC);
+  return block;
+}
+
+/* Unpins tree BLOCK.  A modified tree block is metadata, so it
+   joins the running journal transaction. */
+static void block_unpin(struct extent_block* block, bool dirty) {
+  if (dirty)
+    cache_log(block);
+  cache_unpin(block, dirty);
+}
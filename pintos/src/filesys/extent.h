@@ -0,0 +1,47 @@
+#ifndef FILESYS_EXTENT_H
+#define FILESYS_EXTENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/block.h"
+
+/* A run of LENGTH disk sectors starting at START that holds file
+   sectors LOGICAL through LOGICAL + LENGTH - 1.  The last
+   UNWRITTEN of them were preallocated and never written, so they
+   read as zeros whatever is on disk.  In an index node, START is
+   instead the sector of the child node whose extents begin at
+   LOGICAL, and LENGTH and UNWRITTEN are unused. */
+struct extent {
+  uint32_t logical;     /* First file sector mapped. */
+  block_sector_t start; /* First disk sector, or child node. */
+  uint16_t length;      /* Number of sectors. */
+  uint16_t unwritten;   /* Trailing sectors not yet written. */
+};
+
+/* Longest run a single extent can map. */
+#define EXTENT_MAX_LENGTH UINT16_MAX
+
+/* Header of an extent tree node. */
+struct extent_header {
+  uint16_t cnt;   /* Entries in use. */
+  uint16_t depth; /* 0 if the entries are extents, else index entries. */
+};
+
+/* Entries that fit in the root, which lives in the inode. */
+#define EXTENT_ROOT_CNT 40
+
+/* Root of a file's extent tree, sorted by logical sector. */
+struct extent_root {
+  struct extent_header hdr;
+  struct extent e[EXTENT_ROOT_CNT];
+};
+
+bool extent_lookup(const struct extent_root*, uint32_t logical, struct extent*);
+bool extent_last(const struct extent_root*, struct extent*);
+bool extent_insert(struct extent_root*, uint32_t logical, block_sector_t start, size_t cnt,
+                   bool unwritten);
+bool extent_mark_written(struct extent_root*, uint32_t logical);
+void extent_truncate(struct extent_root*, uint32_t sectors);
+
+#endif /* filesys/extent.h */
@@ -3,6 +3,12 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Read-ahead window bounds, in bytes. */
+#define RA_MIN (4 * BLOCK_SECTOR_SIZE)
+#define RA_MAX (32 * BLOCK_SECTOR_SIZE)
+
+static void file_readahead(struct file* file, off_t ofs, off_t size);
+
 
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
@@ -13,6 +19,9 @@ struct file* file_open(struct inode* inode) {
     file->inode = inode;
     file->pos = 0;
     file->deny_write = false;
+    file->ra_next = 0;
+    file->ra_window = 0;
+    file->ra_end = 0;
     return file;
   } else {
     inode_close(inode);
@@ -47,11 +56,43 @@ struct inode* file_get_inode(struct file* file) {
    which may be less than SIZE if end of file is reached.
    Advances FILE's position by the number of bytes read. */
 off_t file_read(struct file* file, void* buffer, off_t size) {
+  file_readahead(file, file->pos, size);
   off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
   file->pos += bytes_read;
   return bytes_read;
 }
 
+/* Tracks whether FILE is being read sequentially, given a read of
+   SIZE bytes at OFS.  While it is, doubles the read-ahead window
+   on every read up to RA_MAX and asks the inode layer to prefetch
+   what the window covers beyond the part already queued, so the
+   rest of this read and the next ones overlap with disk I/O. */
+static void file_readahead(struct file* file, off_t ofs, off_t size) {
+  off_t start, end;
+
+  if (size <= 0)
+    return;
+  if (ofs != file->ra_next) {
+    file->ra_window = 0;
+    file->ra_next = file->ra_end = ofs + size;
+    return;
+  }
+  if (file->ra_window == 0)
+    file->ra_window = RA_MIN;
+  else if (file->ra_window < RA_MAX)
+    file->ra_window *= 2;
+  file->ra_next = ofs + size;
+
+  /* Refill only once less than half a window is still queued
+     ahead, so that small reads don't each queue a request. */
+  start = file->ra_end > ofs ? file->ra_end : ofs;
+  end = ofs + size + file->ra_window;
+  if (start - (ofs + size) < file->ra_window / 2) {
+    inode_readahead(file->inode, start, end - start);
+    file->ra_end = end;
+  }
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually read,
@@ -85,6 +126,23 @@ off_t file_write_at(struct file* file, const void* buffer, off_t size, off_t fil
   return inode_write_at(file->inode, buffer, size, file_ofs);
 }
 
+/* Reserves disk space for SIZE bytes of FILE starting at offset
+   FILE_OFS, growing the file if they extend past its end, without
+   writing to them.  Returns true if successful, false if writes
+   to FILE are denied or the disk is full.
+   The file's current position is unaffected. */
+bool file_allocate(struct file* file, off_t file_ofs, off_t size) {
+  return inode_preallocate(file->inode, file_ofs, size);
+}
+
+/* Writes FILE's dirty data to disk, along with its inode and the
+   rest of the metadata, or, if DATA_ONLY is true, only as much
+   metadata as it takes to read the data back.  Returns true if
+   successful, false if memory runs out. */
+bool file_sync(struct file* file, bool data_only) {
+  return inode_sync(file->inode, data_only);
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void file_deny_write(struct file* file) {
@@ -11,6 +11,9 @@ struct file {
   struct inode* inode; /* File's inode. */
   off_t pos;           /* Current position. */
   bool deny_write;     /* Has file_deny_write() been called? */
+  off_t ra_next;       /* Offset a sequential reader reads next. */
+  off_t ra_window;     /* Read-ahead window in bytes, 0 if not sequential. */
+  off_t ra_end;        /* End of the range already queued for read-ahead. */
 };
 
 
@@ -25,6 +28,8 @@ off_t file_read(struct file* file, void* buffer, off_t size);
 off_t file_read_at(struct file* file, void* buffer, off_t size, off_t file_ofs);
 off_t file_write(struct file* file, const void* buffer, off_t size);
 off_t file_write_at(struct file* file, const void* buffer, off_t size, off_t file_ofs);
+bool file_allocate(struct file* file, off_t file_ofs, off_t size);
+bool file_sync(struct file* file, bool data_only);
 
 /* Preventing writes. */
 void file_deny_write(struct file* file);
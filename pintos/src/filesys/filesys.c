@@ -7,6 +7,7 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
 #include "threads/thread.h"
 #include "stdlib.h"
 
@@ -15,14 +16,18 @@
 struct block* fs_device;
 
 /* Initializes the file system module.
-   If FORMAT is true, reformats the file system. */
+   If FORMAT is true, reformats the file system.  Otherwise
+   recovers it from the journal first if it was not shut down
+   cleanly. */
 void filesys_init(bool format) {
-  cache_init();
   fs_device = block_get_role(BLOCK_FILESYS);
   if (fs_device == NULL)
     PANIC("No file system device found, can't initialize file system.");
 
+  journal_init(format);
+  cache_init();
   inode_init();
+  dir_init();
   free_map_init();
 
   if (format)
@@ -34,8 +39,9 @@ void filesys_init(bool format) {
 /* Shuts down the file system module, writing any unwritten data
    to disk. */
 void filesys_done(void) {
+  free_map_close();
   flush_cache();
-  free_map_close(); 
+  journal_done();
 }
 
 /* HELPER FUNCTION 
@@ -73,10 +79,15 @@ bool filesys_create(const char* name, off_t initial_size, int is_dir) {
   if(dir == NULL)
     return false;
   
-  /* Acquire a lock on the directory */
+  /* Acquire a lock on the directory, within one journal
+     transaction for the whole creation */
+  journal_begin();
   lock_acquire(&dir->inode->dir_lock);
   
-  bool success = (dir != NULL && free_map_allocate(1, &inode_sector) &&
+  /* A file's inode goes near its directory's; a directory's goes
+     where there is the most room for its own files. */
+  block_sector_t goal = is_dir ? free_map_spread_goal() : dir->inode->sector + 1;
+  bool success = (dir != NULL && free_map_allocate_near(goal, 1, &inode_sector) &&
                   inode_create(inode_sector, initial_size, is_dir) && dir_add(dir, pt->new_dir_name, inode_sector, is_dir));
   if (!success && inode_sector != 0) {
     free_map_release(inode_sector, 1);
@@ -93,11 +104,14 @@ bool filesys_create(const char* name, off_t initial_size, int is_dir) {
     block_sector_t parent = dir->inode->sector;
 
     struct dir *new_dir = dir_open(walk_path(name));
+    lock_acquire(&new_dir->inode->dir_lock);
     success = (dir_add(new_dir, ".", self, 1) && dir_add(new_dir, "..", parent, 1));
+    lock_release(&new_dir->inode->dir_lock);
     dir_close(new_dir);
   }
 
   done:
+  journal_end();
   dir_close(dir);
   free(pt->path_to_dir);
   free(pt->new_dir_name);
@@ -138,11 +152,7 @@ struct file* filesys_open(const char* name) {
     return NULL;
   }
 
-  struct inode_disk *ind_disk = (struct inode_disk*) malloc(sizeof(struct inode_disk));
-  block_read_cached(fs_device, inode->sector, ind_disk, 0, sizeof(struct inode_disk));
-
-  int directory = ind_disk->is_dir;
-  free(ind_disk);
+  int directory = inode_is_dir(inode);
   free(pt->path_to_dir);
   free(pt->new_dir_name);
   free(pt);
@@ -169,7 +179,11 @@ bool filesys_remove(const char* name) {
   if(dir == NULL)
     return false;
 
-  bool success = dir != NULL && dir_remove(dir, pt->new_dir_name);
+  journal_begin();
+  lock_acquire(&dir->inode->dir_lock);
+  bool success = dir_remove(dir, pt->new_dir_name);
+  lock_release(&dir->inode->dir_lock);
+  journal_end();
   dir_close(dir);
 
   free(pt->path_to_dir);
@@ -181,10 +195,12 @@ bool filesys_remove(const char* name) {
 /* Formats the file system. */
 static void do_format(void) {
   printf("Formatting file system...");
+  journal_begin();
   free_map_create();
   if (!dir_create(ROOT_DIR_SECTOR, 16))
     PANIC("root directory creation failed");
   free_map_close();
+  journal_end();
   printf("done.\n");
 }
 
@@ -192,13 +208,8 @@ static void do_format(void) {
  * Sets the struct filedescriptor is_dir based on what the inode is.
  */
 void set_is_dir(struct file_descriptor *file_des) {
-  void *f_ptr = file_des->f_ptr;
-  struct inode_disk *ind_disk = (struct inode_disk*) malloc(sizeof(struct inode_disk));
   struct file *ret = (struct file*) file_des->f_ptr;
-  struct inode *ind = (struct inode*)ret->inode;
-  block_read_cached(fs_device, ind->sector, ind_disk, 0, sizeof(struct inode_disk));
-  file_des->is_dir = ind_disk->is_dir;
-  free(ind_disk);
+  file_des->is_dir = inode_is_dir(ret->inode);
 }
 
 /* HELPER FUNCTION 
@@ -1,51 +1,373 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
+
+/* Sectors whose free map bits share one sector of the free map
+   file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+/* The device is divided into allocation groups of GROUP_SECTORS
+   sectors each.  A count of free sectors per group decides where
+   new directories go. */
+#define GROUP_SECTORS 1024
+
+/* Free space is also indexed by a summary tree: a complete binary
+   tree whose leaves each cover LEAF_SECTORS sectors and whose
+   every node records the free runs in the range it covers.  It
+   finds a run of any length, or the longest run, by visiting
+   O(log n) nodes instead of scanning the bitmap. */
+#define LEAF_SECTORS 32
+
+/* Free runs within a node's range. */
+struct summary {
+  uint32_t pre;  /* Free sectors at the start of the range. */
+  uint32_t suf;  /* Free sectors at the end of the range. */
+  uint32_t best; /* Longest free run in the range. */
+};
+
 static struct file* free_map_file; /* Free map file. */
 static struct bitmap* free_map;    /* Free map, one bit per sector. */
+static struct bitmap* dirty_map;   /* Free map file sectors not yet written. */
 struct lock free_map_lock;         /* Lock for free map */
+static size_t group_cnt;           /* Number of allocation groups. */
+static size_t* group_free;         /* Free sectors in each group. */
+static size_t leaf_cnt;            /* Leaves of the summary tree, a power of 2. */
+static struct summary* summary;    /* Summary tree; node K has children 2K, 2K+1. */
+
+static void map_set(block_sector_t sector, size_t cnt, bool used);
+static void mark_dirty(block_sector_t sector, size_t cnt);
+static void count_groups(void);
+static void summary_update(size_t lo, size_t hi);
+static void leaf_summarize(size_t k);
+static void node_combine(size_t k, size_t half);
+static size_t summary_find(size_t from, size_t cnt);
+static size_t summary_search(size_t k, size_t lo, size_t len, size_t from, size_t cnt,
+                             size_t* run);
+static size_t summary_descend(size_t k, size_t lo, size_t len, size_t cnt, size_t run);
+static size_t leaf_search(size_t lo, size_t hi, size_t cnt, size_t* run);
 
 /* Initializes the free map. */
 void free_map_init(void) {
   free_map = bitmap_create(block_size(fs_device));
   if (free_map == NULL)
     PANIC("bitmap creation failed--file system device is too large");
+  dirty_map = bitmap_create(DIV_ROUND_UP(bitmap_file_size(free_map), BLOCK_SECTOR_SIZE));
+  if (dirty_map == NULL)
+    PANIC("bitmap creation failed--file system device is too large");
+  group_cnt = DIV_ROUND_UP(bitmap_size(free_map), GROUP_SECTORS);
+  group_free = malloc(group_cnt * sizeof *group_free);
+  if (group_free == NULL)
+    PANIC("allocation group table creation failed");
+  for (leaf_cnt = 1; leaf_cnt * LEAF_SECTORS < bitmap_size(free_map); leaf_cnt *= 2)
+    continue;
+  summary = malloc(2 * leaf_cnt * sizeof *summary);
+  if (summary == NULL)
+    PANIC("free space summary creation failed");
   bitmap_mark(free_map, FREE_MAP_SECTOR);
   bitmap_mark(free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple(free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  count_groups();
   lock_init(&free_map_lock);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available.  Only the in-memory map changes; the
+   free map file catches up at the next free_map_flush(). */
 bool free_map_allocate(size_t cnt, block_sector_t* sectorp) {
   lock_acquire(&free_map_lock);
-  block_sector_t sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR && free_map_file != NULL && !bitmap_write(free_map, free_map_file)) {
-    bitmap_set_multiple(free_map, sector, cnt, false);
-    sector = BITMAP_ERROR;
-  }
-  if (sector != BITMAP_ERROR)
+  block_sector_t sector = summary_find(0, cnt);
+  if (sector != BITMAP_ERROR) {
+    map_set(sector, cnt, true);
     *sectorp = sector;
+  }
   lock_release(&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
+/* Allocates up to CNT consecutive sectors, preferring ones that
+   continue a run ending just before GOAL, and stores the first
+   into *SECTORP.  Takes the first run of CNT free sectors at or
+   after GOAL, wrapping around to the start of the disk, which is
+   the run at GOAL whenever that one is long enough.  Only if no
+   run is that long does it settle for less: the free sectors at
+   GOAL if GOAL is free, otherwise the first of the longest runs
+   found as above.  Returns the number of sectors allocated, which
+   is 0 if the disk is full. */
+size_t free_map_allocate_near(block_sector_t goal, size_t cnt, block_sector_t* sectorp) {
+  size_t size = bitmap_size(free_map);
+  size_t sector, got;
+
+  ASSERT(cnt > 0);
+  lock_acquire(&free_map_lock);
+  if (goal >= size)
+    goal = 0;
+  sector = summary_find(goal, cnt);
+  if (sector == BITMAP_ERROR)
+    sector = summary_find(0, cnt);
+  if (sector == BITMAP_ERROR && !bitmap_test(free_map, goal))
+    sector = goal;
+  if (sector == BITMAP_ERROR) {
+    size_t want = cnt < summary[1].best ? cnt : summary[1].best;
+    if (want == 0) {
+      lock_release(&free_map_lock);
+      return 0;
+    }
+    sector = summary_find(goal, want);
+    if (sector == BITMAP_ERROR)
+      sector = summary_find(0, want);
+    ASSERT(sector != BITMAP_ERROR);
+  }
+  for (got = 1; got < cnt && sector + got < size; got++)
+    if (bitmap_test(free_map, sector + got))
+      break;
+
+  map_set(sector, got, true);
+  *sectorp = sector;
+  lock_release(&free_map_lock);
+  return got;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void free_map_release(block_sector_t sector, size_t cnt) {
   ASSERT(bitmap_all(free_map, sector, cnt));
   lock_acquire(&free_map_lock);
-  bitmap_set_multiple(free_map, sector, cnt, false);
-  bitmap_write(free_map, free_map_file);
+  map_set(sector, cnt, false);
   lock_release(&free_map_lock);
 }
 
+/* Returns the first sector of the allocation group with the most
+   free sectors.  New directories start there, so that the files
+   later created in them have room to stay close by. */
+block_sector_t free_map_spread_goal(void) {
+  size_t best = 0, g;
+
+  lock_acquire(&free_map_lock);
+  for (g = 1; g < group_cnt; g++)
+    if (group_free[g] > group_free[best])
+      best = g;
+  lock_release(&free_map_lock);
+  return best * GROUP_SECTORS;
+}
+
+/* Marks CNT sectors starting at SECTOR as USED or free, keeping
+   the group counts and the dirty part of the free map file up to
+   date.  Must be called with free_map_lock held. */
+static void map_set(block_sector_t sector, size_t cnt, bool used) {
+  size_t end = sector + cnt;
+  size_t s;
+
+  bitmap_set_multiple(free_map, sector, cnt, used);
+  mark_dirty(sector, cnt);
+  if (cnt > 0)
+    summary_update(sector / LEAF_SECTORS, (end - 1) / LEAF_SECTORS + 1);
+  for (s = sector; s < end; s = (s / GROUP_SECTORS + 1) * GROUP_SECTORS) {
+    size_t group_end = (s / GROUP_SECTORS + 1) * GROUP_SECTORS;
+    size_t n = (end < group_end ? end : group_end) - s;
+    if (used)
+      group_free[s / GROUP_SECTORS] -= n;
+    else
+      group_free[s / GROUP_SECTORS] += n;
+  }
+}
+
+/* Recomputes every group's free count, and the summary tree,
+   from the free map. */
+static void count_groups(void) {
+  size_t size = bitmap_size(free_map);
+  size_t g;
+
+  for (g = 0; g < group_cnt; g++) {
+    size_t start = g * GROUP_SECTORS;
+    size_t cnt = size - start < GROUP_SECTORS ? size - start : GROUP_SECTORS;
+    group_free[g] = bitmap_count(free_map, start, cnt, false);
+  }
+  summary_update(0, leaf_cnt);
+}
+
+/* Recomputes the summaries of leaves LO through HI - 1, whose
+   sectors changed, and then of every node above them. */
+static void summary_update(size_t lo, size_t hi) {
+  size_t len = LEAF_SECTORS;
+  size_t k;
+
+  for (k = lo; k < hi; k++)
+    leaf_summarize(k);
+  for (lo += leaf_cnt, hi += leaf_cnt - 1; lo > 1; lo /= 2, hi /= 2, len *= 2)
+    for (k = lo / 2; k <= hi / 2; k++)
+      node_combine(k, len);
+}
+
+/* Recomputes the summary of leaf K, which covers LEAF_SECTORS
+   sectors.  Sectors past the end of the device count as used. */
+static void leaf_summarize(size_t k) {
+  struct summary* s = &summary[leaf_cnt + k];
+  size_t size = bitmap_size(free_map);
+  size_t lo = k * LEAF_SECTORS;
+  size_t run = 0;
+  size_t i;
+
+  s->pre = s->best = 0;
+  for (i = 0; i < LEAF_SECTORS; i++) {
+    if (lo + i < size && !bitmap_test(free_map, lo + i)) {
+      if (++run > s->best)
+        s->best = run;
+    } else {
+      if (run == i)
+        s->pre = run;
+      run = 0;
+    }
+  }
+  if (run == LEAF_SECTORS)
+    s->pre = run;
+  s->suf = run;
+}
+
+/* Recomputes the summary of interior node K from its children,
+   which each cover HALF sectors. */
+static void node_combine(size_t k, size_t half) {
+  const struct summary* l = &summary[2 * k];
+  const struct summary* r = &summary[2 * k + 1];
+  struct summary* s = &summary[k];
+
+  s->pre = l->pre == half ? half + r->pre : l->pre;
+  s->suf = r->suf == half ? half + l->suf : r->suf;
+  s->best = l->best > r->best ? l->best : r->best;
+  if (l->suf + r->pre > s->best)
+    s->best = l->suf + r->pre;
+}
+
+/* Returns the first sector at or after FROM that begins a run of
+   CNT free sectors, or BITMAP_ERROR if there is none.  Runs may
+   not reach back before FROM.  Visits O(log n) nodes plus a leaf
+   or two. */
+static size_t summary_find(size_t from, size_t cnt) {
+  size_t run = 0;
+
+  ASSERT(cnt > 0);
+  return summary_search(1, 0, leaf_cnt * LEAF_SECTORS, from, cnt, &run);
+}
+
+/* Searches node K, which covers the LEN sectors starting at LO,
+   for the first run of CNT free sectors that starts at or after
+   FROM, given that the *RUN sectors just before LO are free and
+   at or after FROM.  Returns its start, or BITMAP_ERROR after
+   setting *RUN to the free run that the node ends with. */
+static size_t summary_search(size_t k, size_t lo, size_t len, size_t from, size_t cnt,
+                             size_t* run) {
+  const struct summary* s = &summary[k];
+
+  if (lo + len <= from) {
+    *run = 0;
+    return BITMAP_ERROR;
+  }
+  if (lo >= from) {
+    if (*run + s->pre >= cnt)
+      return lo - *run;
+    if (s->best >= cnt)
+      return summary_descend(k, lo, len, cnt, *run);
+    *run = s->pre == len ? *run + len : s->suf;
+    return BITMAP_ERROR;
+  }
+  if (len == LEAF_SECTORS)
+    return leaf_search(from, lo + len, cnt, run);
+
+  size_t sector = summary_search(2 * k, lo, len / 2, from, cnt, run);
+  if (sector == BITMAP_ERROR)
+    sector = summary_search(2 * k + 1, lo + len / 2, len / 2, from, cnt, run);
+  return sector;
+}
+
+/* Returns the start of the first run of CNT free sectors that
+   ends within node K, which covers the LEN sectors starting at LO,
+   given that the RUN sectors just before LO are free.  There must
+   be such a run. */
+static size_t summary_descend(size_t k, size_t lo, size_t len, size_t cnt, size_t run) {
+  while (len > LEAF_SECTORS) {
+    const struct summary* l = &summary[2 * k];
+    size_t half = len / 2;
+
+    if (run + l->pre >= cnt)
+      return lo - run;
+    if (l->best >= cnt) {
+      run = 0;
+      k = 2 * k;
+    } else {
+      run = l->pre == half ? run + half : l->suf;
+      lo += half;
+      k = 2 * k + 1;
+    }
+    len = half;
+  }
+  return leaf_search(lo, lo + len, cnt, &run);
+}
+
+/* Returns the start of the first run of CNT free sectors ending
+   in [LO, HI), given that the *RUN sectors just before LO are
+   free, or BITMAP_ERROR after setting *RUN to the free run that
+   ends at HI. */
+static size_t leaf_search(size_t lo, size_t hi, size_t cnt, size_t* run) {
+  size_t size = bitmap_size(free_map);
+  size_t i;
+
+  for (i = lo; i < hi; i++) {
+    if (i < size && !bitmap_test(free_map, i)) {
+      if (++*run >= cnt)
+        return i + 1 - cnt;
+    } else {
+      *run = 0;
+    }
+  }
+  return BITMAP_ERROR;
+}
+
+/* Records that the free map bits of CNT sectors starting at
+   SECTOR changed.  Must be called with free_map_lock held. */
+static void mark_dirty(block_sector_t sector, size_t cnt) {
+  size_t first = sector / BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+  if (cnt > 0)
+    bitmap_set_multiple(dirty_map, first, last - first + 1, true);
+}
+
+/* Returns the number of sectors in the free map file, all of
+   which free_map_flush() may have to write.  Depends only on the
+   size of the file system device, so it may be called before
+   free_map_init(). */
+size_t free_map_file_sectors(void) { return DIV_ROUND_UP(block_size(fs_device), BITS_PER_SECTOR); }
+
+/* Writes the sectors of the free map file whose bits changed
+   since they were last written.  They go to the buffer cache, to
+   reach disk with the next journal commit, which calls this first;
+   allocating and releasing sectors themselves never touch the
+   file.  The journal transaction is begun before taking
+   free_map_lock, which a commit needs. */
+void free_map_flush(void) {
+  size_t i;
+
+  journal_begin();
+  lock_acquire(&free_map_lock);
+  if (free_map_file != NULL) {
+    for (i = bitmap_scan(dirty_map, 0, 1, true); i != BITMAP_ERROR;
+         i = bitmap_scan(dirty_map, i + 1, 1, true)) {
+      bitmap_reset(dirty_map, i);
+      if (!bitmap_write_bytes(free_map, free_map_file, i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE))
+        PANIC("can't write free map");
+    }
+  }
+  lock_release(&free_map_lock);
+  journal_end();
+}
+
 /* Opens the free map file and reads it from disk. */
 void free_map_open(void) {
   free_map_file = file_open(inode_open(FREE_MAP_SECTOR));
@@ -53,10 +375,21 @@ void free_map_open(void) {
     PANIC("can't open free map");
   if (!bitmap_read(free_map, free_map_file))
     PANIC("can't read free map");
+  bitmap_set_all(dirty_map, false);
+  count_groups();
 }
 
 /* Writes the free map to disk and closes the free map file. */
-void free_map_close(void) { file_close(free_map_file); }
+void free_map_close(void) {
+  struct file* file;
+
+  free_map_flush();
+  lock_acquire(&free_map_lock);
+  file = free_map_file;
+  free_map_file = NULL;
+  lock_release(&free_map_lock);
+  file_close(file);
+}
 
 /* Creates a new free map file on disk and writes the free map to
    it. */
@@ -65,10 +398,17 @@ void free_map_create(void) {
   if (!inode_create(FREE_MAP_SECTOR, bitmap_file_size(free_map), 1))
     PANIC("free map creation failed");
 
+  /* Give the file all its sectors now: allocating them later would
+     mean writing the free map while writing the free map. */
+  struct inode* inode = inode_open(FREE_MAP_SECTOR);
+  if (inode == NULL || !inode_allocate(inode, 0, bitmap_file_size(free_map)))
+    PANIC("free map creation failed");
+
   /* Write bitmap to file. */
-  free_map_file = file_open(inode_open(FREE_MAP_SECTOR));
+  free_map_file = file_open(inode);
   if (free_map_file == NULL)
     PANIC("can't open free map");
   if (!bitmap_write(free_map, free_map_file))
     PANIC("can't write free map");
+  bitmap_set_all(dirty_map, false);
 }
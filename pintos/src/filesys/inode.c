@@ -6,229 +6,597 @@
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Most read-ahead requests that may wait for the read-ahead
+   thread; further requests are dropped. */
+#define READAHEAD_QUEUE_MAX 16
+
+/* A range of an inode to prefetch into the buffer cache. */
+struct readahead {
+  struct list_elem elem; /* Element in readahead_queue. */
+  struct inode* inode;   /* Reopened for the request's lifetime. */
+  off_t start;           /* First byte to prefetch. */
+  off_t end;             /* One past the last byte to prefetch. */
+};
+
+static struct list readahead_queue;
+static size_t readahead_cnt;
+static struct lock readahead_lock;
+static struct condition readahead_cond;
+
+static void readahead_thread(void* aux UNUSED);
+static void write_disk_inode(block_sector_t sector, const struct inode_disk* id);
+static void write_inode(struct inode* inode);
+static bool inode_extend(struct inode* inode, off_t size);
+static bool inline_to_extents(struct inode_disk* id, block_sector_t sector);
+static bool allocate_range(struct inode* inode, uint32_t* logical, uint32_t end, bool unwritten);
+static void claim_unwritten(struct inode* inode, off_t offset, off_t length);
+static void claim_range(struct inode* inode, uint32_t* logical, uint32_t end);
+static bool range_mapped(const struct extent_root* root, uint32_t logical, uint32_t end,
+                         bool written);
 
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t bytes_to_sectors(off_t size) { return DIV_ROUND_UP(size, BLOCK_SECTOR_SIZE); }
 
+/* Finds the block device sector that contains byte offset POS
+   within INODE and stores it in *START.  Returns how many sectors
+   from there on are consecutive on disk, or 0, with *START set to
+   0, if INODE does not contain data for a byte at offset POS.
+   Preallocated sectors that were never written count as holes.
+   Sequential access stays within the extent found last, so it
+   needs no extent tree reads.  Lookups share the map lock, so
+   only the remembered extent needs protecting among them. */
+static size_t byte_to_run(struct inode* inode, off_t pos, block_sector_t* start) {
+  uint32_t logical = pos / BLOCK_SECTOR_SIZE;
+  enum intr_level old_level;
+  struct extent ext;
+  size_t run = 0;
+
+  ASSERT(inode != NULL);
+  *start = 0;
+  rwlock_acquire_read(&inode->map_lock);
+  if (!(inode->data.flags & INODE_INLINE)) {
+    old_level = intr_disable();
+    ext = inode->last_extent;
+    intr_set_level(old_level);
+    bool found = logical - ext.logical < ext.length;
+    if (!found && extent_lookup(&inode->data.extents, logical, &ext)) {
+      found = true;
+      old_level = intr_disable();
+      inode->last_extent = ext;
+      intr_set_level(old_level);
+    }
+    if (found && logical - ext.logical < (uint32_t)(ext.length - ext.unwritten)) {
+      *start = ext.start + (logical - ext.logical);
+      run = ext.length - ext.unwritten - (logical - ext.logical);
+    }
+  }
+  rwlock_release_read(&inode->map_lock);
+  return run;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns 0 if INODE does not contain data for a byte at offset
    POS. */
-static block_sector_t byte_to_sector(const struct inode* inode, off_t pos) {
-  ASSERT(inode != NULL);
-  lock_acquire(&inode->lookup_lock);
-  struct inode_disk* di = malloc(BLOCK_SECTOR_SIZE);
-  block_read_cached(fs_device, inode->sector, di, 0, BLOCK_SECTOR_SIZE);
-  block_sector_t* buffer = malloc(BLOCK_SECTOR_SIZE);
-  block_sector_t result = 0;
-  /* Traverse pointers to find the corresponding sector based on the position */
-  if (pos > DOUBLE_MAX) {
-    result = 0;
-  } else if (pos < DIRECT_MAX) {
-    result = di->direct[pos / BLOCK_SECTOR_SIZE];
-  } else if (pos < INDIRECT_MAX) {
-    if (di->indirect != 0) {
-      block_read_cached(fs_device, di->indirect, buffer, 0, BLOCK_SECTOR_SIZE);
-      result = buffer[(pos - DIRECT_MAX) / BLOCK_SECTOR_SIZE];
-    }
-  } else if (pos < DOUBLE_MAX) {
-    if (di->double_indirect != 0) {
-     block_read_cached(fs_device, di->double_indirect, buffer, 0, BLOCK_SECTOR_SIZE);
-     block_sector_t sector = buffer[(pos - 128512) / BLOCK_SECTOR_SIZE / 128]; 
-      if (sector != 0) {
-        block_read_cached(fs_device, sector, buffer, 0, BLOCK_SECTOR_SIZE);
-        result =  buffer[(pos - INDIRECT_MAX) / BLOCK_SECTOR_SIZE % 128];
-      }
-    }
-  } 
-  free(di);
-  free(buffer);
-  lock_release(&inode->lookup_lock);
-  return result;
+static block_sector_t byte_to_sector(struct inode* inode, off_t pos) {
+  block_sector_t sector;
+
+  byte_to_run(inode, pos, &sector);
+  return sector;
 }
-bool inode_resize_unsafe(block_sector_t id_sector, off_t size);
 
-/* Wrapper function to make inode_resize_unsafe thread-safe. */
+/* Writes ID, the inode in SECTOR, back through the cache as part
+   of the running journal transaction. */
+static void write_disk_inode(block_sector_t sector, const struct inode_disk* id) {
+  void* frame = cache_pin(fs_device, sector, CACHE_CREATE);
+  memcpy(frame, id, BLOCK_SECTOR_SIZE);
+  cache_log(frame);
+  cache_unpin(frame, true);
+}
+
+/* Writes INODE's on-disk inode back through the cache, recording
+   the transaction that changed it for inode_sync(). */
+static void write_inode(struct inode* inode) {
+  write_disk_inode(inode->sector, &inode->data);
+  inode->logged_seq = journal_seq();
+}
+
+/* Wrapper function to make inode_resize_unsafe thread-safe.
+   Writes the updated inode back through the cache. */
 bool inode_resize(struct inode* inode, off_t size) {
-  lock_acquire(&inode->lookup_lock);
-  bool success = inode_resize_unsafe(inode->sector, size);
-  lock_release(&inode->lookup_lock);
+  journal_begin();
+  rwlock_acquire_write(&inode->map_lock);
+  bool success = inode_resize_unsafe(&inode->data, inode->sector, size);
+  inode->last_extent.length = 0;
+  write_inode(inode);
+  rwlock_release_write(&inode->map_lock);
+  journal_end();
   return success;
 }
 
-/* Function to resize the inode_disk. May expand or shrink. */
-bool inode_resize_unsafe(block_sector_t id_sector, off_t size) {
-  /* Return if size is too large */
-  if (size > DOUBLE_MAX) {
+/* Extends INODE to SIZE bytes if it is shorter.  The length is
+   checked again under the map lock, so that of two writers
+   appending at once, the one reaching less far never shrinks the
+   file behind the other.  Returns false if the file is still
+   shorter than SIZE. */
+static bool inode_extend(struct inode* inode, off_t size) {
+  bool success = true;
+
+  journal_begin();
+  rwlock_acquire_write(&inode->map_lock);
+  if (inode->data.length < size) {
+    success = inode_resize_unsafe(&inode->data, inode->sector, size);
+    if (success) {
+      inode->last_extent.length = 0;
+      write_inode(inode);
+    }
+  }
+  rwlock_release_write(&inode->map_lock);
+  journal_end();
+  return success;
+}
+
+/* Function to resize the inode_disk ID, which belongs in SECTOR.
+   May expand or shrink.
+   Updates ID in memory only, so the caller must write it back.
+   Growing just moves the end of file: the new range is a hole,
+   which reads as zeros and gets sectors when first written.  An
+   inline file that outgrows the inode moves its data to a sector.
+   Must be called within a journal transaction. */
+bool inode_resize_unsafe(struct inode_disk* id, block_sector_t sector, off_t size) {
+  struct extent ext;
+
+  if (size < 0)
     return false;
+  if (id->flags & INODE_INLINE) {
+    if (size > INODE_INLINE_MAX) {
+      if (!inline_to_extents(id, sector))
+        return false;
+    } else {
+      if (size < id->length)
+        memset(id->data + size, 0, id->length - size);
+      id->length = size;
+      return true;
+    }
   }
-  static int zeros[BLOCK_SECTOR_SIZE];
-  struct inode_disk * id = malloc(BLOCK_SECTOR_SIZE);
-  block_read_cached(fs_device, id_sector, id, 0, BLOCK_SECTOR_SIZE);
-  block_sector_t sector;
-  /* Direct pointers */
-  for (int i = 0; i < 123; i++) {
-    /* Shrink */
-    if (size <= 512 * i && id->direct[i] != 0) {
-      free_map_release(id->direct[i], 1);
-      id->direct[i] = 0;
+  if (size < id->length) {
+    extent_truncate(&id->extents, bytes_to_sectors(size));
+    /* Clear the tail of the new last sector, so that growing the
+       file again exposes zeros rather than the old data. */
+    if (size % BLOCK_SECTOR_SIZE != 0 &&
+        extent_lookup(&id->extents, size / BLOCK_SECTOR_SIZE, &ext)) {
+      char* frame = cache_pin(fs_device, ext.start + (size / BLOCK_SECTOR_SIZE - ext.logical),
+                              CACHE_WRITE);
+      memset(frame + size % BLOCK_SECTOR_SIZE, 0, BLOCK_SECTOR_SIZE - size % BLOCK_SECTOR_SIZE);
+      if (id->is_dir)
+        cache_log(frame);
+      cache_own(frame, sector);
+      cache_unpin(frame, true);
     }
-    /* Expand */
-    if (size > 512 * i && id->direct[i] == 0) {
-      if (!free_map_allocate(1, &sector)) {
-      inode_resize_unsafe(id_sector, id->length);
-      free(id);
+  }
+  id->length = size;
+  return true;
+}
+
+/* Switches inline inode ID, stored in INODE_SECTOR, to mapping
+   its data with extents, moving any data to a newly allocated
+   sector near the inode.  A directory's data is metadata, so it
+   moves within the journal transaction.  Returns false if the
+   disk is full. */
+static bool inline_to_extents(struct inode_disk* id, block_sector_t inode_sector) {
+  block_sector_t sector = 0;
+
+  if (id->length > 0) {
+    char* frame;
+
+    if (free_map_allocate_near(inode_sector + 1, 1, &sector) == 0)
       return false;
-      }
-      block_write_cached(fs_device, sector, zeros, 0, BLOCK_SECTOR_SIZE);
-      id->direct[i] = sector;
-    }
+    frame = cache_pin(fs_device, sector, CACHE_CREATE);
+    memcpy(frame, id->data, id->length);
+    memset(frame + id->length, 0, BLOCK_SECTOR_SIZE - id->length);
+    if (id->is_dir)
+      cache_log(frame);
+    else
+      cache_order(frame);
+    cache_own(frame, inode_sector);
+    cache_unpin(frame, true);
   }
-  /* If the direct pointers are sufficient, return */
-  if (id->indirect == 0 && size <= 123 * 512) {
-    id->length = size;
-    block_write_cached(fs_device, id_sector, id, 0, BLOCK_SECTOR_SIZE); 
-    free(id);
+  memset(&id->extents, 0, sizeof id->extents);
+  id->flags &= ~INODE_INLINE;
+  if (sector != 0)
+    extent_insert(&id->extents, 0, sector, 1, false);
+  return true;
+}
+
+/* Gives every hole in the LENGTH bytes of INODE starting at
+   OFFSET newly allocated sectors, which read as zeros.  Each hole
+   is allocated as one run where possible, continuing on disk from
+   the sector before it.  Returns false if the disk fills up.
+   Overwrites of allocated data, the common case, only check the
+   range under the shared side of the map lock.  A large range is
+   allocated in several journal transactions, unless the caller
+   is within one already. */
+bool inode_allocate(struct inode* inode, off_t offset, off_t length) {
+  uint32_t logical = offset / BLOCK_SECTOR_SIZE;
+  uint32_t end = bytes_to_sectors(offset + length);
+  bool mapped;
+  bool success = true;
+
+  if (length <= 0)
+    return true;
+  rwlock_acquire_read(&inode->map_lock);
+  mapped = (inode->data.flags & INODE_INLINE) ||
+           range_mapped(&inode->data.extents, logical, end, false);
+  rwlock_release_read(&inode->map_lock);
+  if (mapped)
     return true;
+
+  while (success && logical < end) {
+    journal_begin();
+    rwlock_acquire_write(&inode->map_lock);
+    success = allocate_range(inode, &logical, end, false);
+    rwlock_release_write(&inode->map_lock);
+    journal_end();
   }
-  block_sector_t* buffer = malloc(BLOCK_SECTOR_SIZE);
-  /* Allocate a new intermediate sector if not yet */
-  if (id->indirect == 0) {
-    memset(buffer, 0, 512);
-    /* Roll back */
-    if (!free_map_allocate(1, &sector)) {
-      inode_resize_unsafe(id_sector, id->length);
-      free(buffer);
-      free(id);
-      return false;
-    }
-    id->indirect = sector;
-  } else {
-    /* Read the intermediate sector */
-    block_read_cached(fs_device, id->indirect, buffer, 0, BLOCK_SECTOR_SIZE);
+  return success;
+}
+
+/* Reserves disk space for the LENGTH bytes of INODE starting at
+   OFFSET, extending the file if they reach past its end.  Holes
+   in the range get contiguous runs of sectors, which are left
+   unwritten rather than zeroed, so that reserving costs no I/O
+   and later writes and reads of the range stay sequential on
+   disk.  Returns false if writes to INODE are denied, the range
+   is invalid, or the disk fills up. */
+bool inode_preallocate(struct inode* inode, off_t offset, off_t length) {
+  uint32_t logical, end;
+  bool success;
+
+  if (offset < 0 || length <= 0 || offset > INT32_MAX - length)
+    return false;
+
+  /* Check in */
+  lock_acquire(&inode->dny_w_lock);
+  if (inode->deny_write_cnt) {
+    lock_release(&inode->dny_w_lock);
+    return false;
   }
-  /* Allocate sectors for each pointer on intermediate sector if neceessary*/
-  for (int i = 0; i < 128; i++) {
-    /* Shrink */
-    if (size <= (123 + i) * 512 && buffer[i] != 0) {
-      free_map_release(buffer[i], 1);
-      buffer[i] = 0;
+  inode->writers++;
+  lock_release(&inode->dny_w_lock);
+
+  success = inode_length(inode) >= offset + length || inode_extend(inode, offset + length);
+  logical = offset / BLOCK_SECTOR_SIZE;
+  end = bytes_to_sectors(offset + length);
+  while (success && logical < end) {
+    journal_begin();
+    rwlock_acquire_write(&inode->map_lock);
+    success = allocate_range(inode, &logical, end, true);
+    rwlock_release_write(&inode->map_lock);
+    journal_end();
+  }
+
+  /* Check out */
+  lock_acquire(&inode->dny_w_lock);
+  inode->writers--;
+  cond_broadcast(&inode->dny_w_cond, &inode->dny_w_lock);
+  lock_release(&inode->dny_w_lock);
+  return success;
+}
+
+/* Writes the dirty data of INODE back to disk and then commits
+   the journal, which brings INODE's inode sector and extent tree
+   blocks to disk along with the rest of the metadata changed so
+   far and the data sectors that metadata newly maps.  Other files'
+   dirty data stays in the cache unless the running transaction
+   allocated it.  If
+   DATA_ONLY is true, as for fdatasync(), a file commits only if
+   its length or sectors changed since the last commit; an
+   overwrite in place then costs just the data writes.  A
+   directory's data is metadata, so it always commits.  Returns
+   false if memory runs out. */
+bool inode_sync(struct inode* inode, bool data_only) {
+  if (!cache_sync(inode->sector))
+    return false;
+  if (!data_only || inode_is_dir(inode) || inode->logged_seq == journal_seq())
+    journal_commit();
+  return true;
+}
+
+/* Maps holes among file sectors *LOGICAL up to but not including
+   END of INODE to newly allocated sectors, marked unwritten if
+   UNWRITTEN is true and otherwise zeroed, advancing *LOGICAL past
+   the sectors it handles.  Stops early, leaving the rest for
+   another transaction, before the tree blocks it changes might
+   take it past what one journal operation may log.  Returns false
+   if the disk fills up.  Must be called with INODE's map lock held
+   exclusively, within a journal transaction. */
+static bool allocate_range(struct inode* inode, uint32_t* logical, uint32_t end, bool unwritten) {
+  struct extent_root* root = &inode->data.extents;
+  size_t logged = 1; /* The inode. */
+  bool changed = false;
+  bool success = true;
+
+  if (inode->data.flags & INODE_INLINE) {
+    *logical = end;
+    return true;
+  }
+  while (*logical < end) {
+    struct extent ext;
+    block_sector_t goal, start;
+    size_t want, cnt, i;
+    /* An insertion logs the path below the root, and a split adds
+       a block at each level and one more for the root. */
+    size_t cost = 2 * root->hdr.depth + 1;
+
+    if (extent_lookup(root, *logical, &ext)) {
+      *logical = ext.logical + ext.length;
+      continue;
     }
-    /* Expand */
-    if (size > (123 + i) * 512 && buffer[i] == 0) {
-      if (!free_map_allocate(1, &sector)) { // Handle failure
-        inode_resize_unsafe(id_sector, id->length);
-        free(buffer);
-        free(id);
-        return false;
-      }
-      block_write_cached(fs_device, sector, zeros, 0, BLOCK_SECTOR_SIZE);
-      buffer[i] = sector;
+    if (changed && logged + cost > JOURNAL_OP_MAX)
+      break;
+    logged += cost;
+    for (want = 1; *logical + want < end && want < EXTENT_MAX_LENGTH; want++)
+      if (extent_lookup(root, *logical + want, &ext))
+        break;
+
+    /* Continue the run holding the sector before *LOGICAL: straight
+       from the hint when the last allocation ended there, as it
+       does for appends, otherwise from the extent map.  A file's
+       first sectors go just after its inode. */
+    if (*logical == inode->next_logical && inode->next_goal != 0)
+      goal = inode->next_goal;
+    else if (*logical > 0 && extent_lookup(root, *logical - 1, &ext))
+      goal = ext.start + (*logical - ext.logical);
+    else
+      goal = inode->sector + 1;
+
+    cnt = free_map_allocate_near(goal, want, &start);
+    if (cnt == 0) {
+      success = false;
+      break;
+    }
+    if (!extent_insert(root, *logical, start, cnt, unwritten)) {
+      free_map_release(start, cnt);
+      success = false;
+      break;
     }
+    /* Zero the new sectors in the cache only.  They reach disk
+       once, when written back, usually carrying the caller's data,
+       and at the latest when the transaction mapping them commits. */
+    for (i = 0; !unwritten && i < cnt; i++) {
+      void* frame = cache_pin(fs_device, start + i, CACHE_CREATE);
+      memset(frame, 0, BLOCK_SECTOR_SIZE);
+      cache_own(frame, inode->sector);
+      cache_order(frame);
+      cache_unpin(frame, true);
+    }
+    changed = true;
+    *logical += cnt;
+    inode->next_logical = *logical;
+    inode->next_goal = start + cnt;
   }
-  if (id->indirect != 0 && size <= DIRECT_MAX) {
-    free_map_release(id->indirect, 1);
-    id->length = size;
-    block_write_cached(fs_device, id_sector, id, 0, BLOCK_SECTOR_SIZE);
-    free(buffer);
-    free(id);
-    return true;
-  } else {
-    block_write_cached(fs_device, id->indirect, buffer, 0, BLOCK_SECTOR_SIZE);
+  if (changed) {
+    if (unwritten)
+      inode->data.flags |= INODE_PREALLOC;
+    write_inode(inode);
   }
-  /* If direct & indirect pointer are sufficient, return */
-  if (id->double_indirect == 0 && size <= INDIRECT_MAX) {
-    id->length = size;
-    block_write_cached(fs_device, id_sector, id, 0, BLOCK_SECTOR_SIZE);
-    free(buffer);
-    free(id);
-    return true;
+  return success;
+}
+
+/* Readies the sectors of INODE that the LENGTH bytes at OFFSET
+   touch for being written, where they were preallocated and never
+   written.  Those sectors, and the unwritten ones before them in
+   the same extent, are zeroed in the cache and marked written, so
+   that neither the rest of a partly written sector nor a sector
+   skipped over exposes what was on disk before.  A large range is
+   claimed in several journal transactions, as in
+   inode_allocate(). */
+static void claim_unwritten(struct inode* inode, off_t offset, off_t length) {
+  uint32_t logical = offset / BLOCK_SECTOR_SIZE;
+  uint32_t end = bytes_to_sectors(offset + length);
+  bool written;
+
+  if (length <= 0)
+    return;
+  rwlock_acquire_read(&inode->map_lock);
+  written = (inode->data.flags & INODE_INLINE) ||
+            range_mapped(&inode->data.extents, logical, end, true);
+  rwlock_release_read(&inode->map_lock);
+  if (written)
+    return;
+
+  while (logical < end) {
+    journal_begin();
+    rwlock_acquire_write(&inode->map_lock);
+    claim_range(inode, &logical, end);
+    rwlock_release_write(&inode->map_lock);
+    journal_end();
   }
-  /* Allocate a new layer 1 intermediate sector if now yet */
-  if (id->double_indirect == 0) {
-    memset(buffer, 0, 512);
-    if (!free_map_allocate(1, &sector)) {
-      inode_resize_unsafe(id_sector, id->length);
-      free(buffer);
-      free(id);
-      return false;
-    }
-    id->double_indirect = sector;
-  } else {
-    /* Read the layer 1 intermediate sector if it has already been allocated */
-    block_read_cached(fs_device, id->double_indirect, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Claims the unwritten sectors among file sectors *LOGICAL up to
+   but not including END of INODE for claim_unwritten(), advancing
+   *LOGICAL past the sectors it handles.  Stops early, like
+   allocate_range(), before it might log more than one journal
+   operation may.  Must be called with INODE's map lock held
+   exclusively, within a journal transaction. */
+static void claim_range(struct inode* inode, uint32_t* logical, uint32_t end) {
+  struct extent_root* root = &inode->data.extents;
+  size_t logged = 1; /* The inode. */
+  bool changed = false;
+
+  if (inode->data.flags & INODE_INLINE) {
+    *logical = end;
+    return;
   }
+  while (*logical < end) {
+    struct extent ext;
+    uint32_t valid, upto, i;
 
-  /* Allocate layer2 intermediate sector if not yet */
-  block_sector_t* buffer2 = malloc(BLOCK_SECTOR_SIZE);
-  /* Iterate through the layer 1 intermediate sector */
-  for (int i = 0; i < 128; i++) {
-    /* Return if all required space has been satisfied. */
-    if (buffer[i] == 0 && size <= INDIRECT_MAX + i * 128 * 512) {
-      if (i == 0) {
-        free_map_release(id->double_indirect, 1);
-      } else {
-        block_write_cached(fs_device, id->double_indirect, buffer, 0, BLOCK_SECTOR_SIZE);
-      }
-      id->length = size;
-      block_write_cached(fs_device, id_sector, id, 0, BLOCK_SECTOR_SIZE);
-      free(buffer);
-      free(id);
-      free(buffer2);
-      return true;
+    if (!extent_lookup(root, *logical, &ext)) {
+      (*logical)++;
+      continue;
     }
-    if (buffer[i] == 0) {
-      memset(buffer2, 0, 512);
-      if (!free_map_allocate(1, &sector)) {
-        inode_resize_unsafe(id_sector, id->length);
-        free(buffer);
-        free(buffer2);
-        free(id);
-        return false;
-      }
-      buffer[i] = sector;
-    } else {
-      /* Read layer2 intermediate sector if it has already been allocated */
-      block_read_cached(fs_device, buffer[i], buffer2, 0, BLOCK_SECTOR_SIZE);
-    }
-    /* Iterate through layer2 intermediate sector */
-    for (int j = 0; j < 128; j++) {
-      /* Shrink */
-      if (size <= 123 * 512 + 128 * 512 + i * 128 * 512 + j * 512 && buffer2[j] != 0) {
-        free_map_release(buffer2[j], 1);
-        buffer2[j] = 0;
-      }
-      /* Expand */
-      if (size > 123 * 512 + 128 * 512 + i * 128 * 512 + j * 512 && buffer2[j] == 0) {
-        if (!free_map_allocate(1, &sector)) { // Handle failure
-          inode_resize_unsafe(id_sector, id->length);
-          free(buffer);
-          free(buffer2);
-          free(id);
-          return false;
-        }
-        block_write_cached(fs_device, sector, zeros, 0, BLOCK_SECTOR_SIZE);
-        buffer2[j] = sector;
+    valid = ext.logical + ext.length - ext.unwritten;
+    upto = ext.logical + ext.length < end ? ext.logical + ext.length : end;
+    if (upto > valid) {
+      /* Marking the extent written logs the path below the root. */
+      if (changed && logged + root->hdr.depth > JOURNAL_OP_MAX)
+        break;
+      logged += root->hdr.depth;
+      for (i = valid; i < upto; i++) {
+        void* frame = cache_pin(fs_device, ext.start + (i - ext.logical), CACHE_CREATE);
+        memset(frame, 0, BLOCK_SECTOR_SIZE);
+        cache_own(frame, inode->sector);
+        cache_order(frame);
+        cache_unpin(frame, true);
       }
+      extent_mark_written(root, upto - 1);
+      changed = true;
     }
-    block_write_cached(fs_device, buffer[i], buffer2, 0, BLOCK_SECTOR_SIZE);
+    *logical = ext.logical + ext.length;
   }
+  if (changed) {
+    inode->last_extent.length = 0;
+    write_inode(inode);
+  }
+}
+
+/* Returns true if ROOT maps every file sector from LOGICAL up to
+   but not including END, and, if WRITTEN is true, none of them
+   is unwritten. */
+static bool range_mapped(const struct extent_root* root, uint32_t logical, uint32_t end,
+                         bool written) {
+  struct extent ext;
+
+  while (logical < end) {
+    if (!extent_lookup(root, logical, &ext))
+      return false;
+    if (written && ext.unwritten > 0 && ext.logical + ext.length - ext.unwritten < end)
+      return false;
+    logical = ext.logical + ext.length;
+  }
+  return true;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Open inodes, so that opening a single inode twice returns the
+   same `struct inode'.  The table is split by sector into buckets,
+   each a separately locked hash table, so that opening or closing
+   one inode neither scans nor waits for the others. */
+#define OPEN_INODE_BUCKETS 32
+
+struct inode_bucket {
+  struct lock lock;   /* Protects INODES. */
+  struct hash inodes; /* Open inodes, keyed by sector. */
+};
+
+static struct inode_bucket open_inodes[OPEN_INODE_BUCKETS];
+
+/* Search key for the open inode table.  It has just the members of
+   struct inode that inode_hash() and inode_less() read, at the same
+   offsets, so that a lookup need not put a whole inode, with its
+   inode_disk, on the kernel stack. */
+struct inode_key {
+  struct hash_elem elem;
+  block_sector_t sector;
+};
 
-/* Global lock for open_inodes list */
-struct lock open_inodes_lock;
+static unsigned inode_hash(const struct hash_elem* e, void* aux UNUSED);
+static bool inode_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED);
+
+/* Returns the bucket of open_inodes that holds SECTOR. */
+static struct inode_bucket* bucket_of(block_sector_t sector) {
+  return &open_inodes[sector % OPEN_INODE_BUCKETS];
+}
+
+/* Hashes an open inode by its sector number. */
+static unsigned inode_hash(const struct hash_elem* e, void* aux UNUSED) {
+  return hash_int(hash_entry(e, struct inode, elem)->sector);
+}
+
+/* Orders open inodes by sector number. */
+static bool inode_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED) {
+  return hash_entry(a, struct inode, elem)->sector < hash_entry(b, struct inode, elem)->sector;
+}
 
 /* Initializes the inode module. */
-void inode_init(void) { 
-  list_init(&open_inodes);
-  lock_init(&open_inodes_lock);
- }
+void inode_init(void) {
+  size_t i;
+
+  ASSERT(offsetof(struct inode, elem) == offsetof(struct inode_key, elem));
+  ASSERT(offsetof(struct inode, sector) == offsetof(struct inode_key, sector));
+  for (i = 0; i < OPEN_INODE_BUCKETS; i++) {
+    lock_init(&open_inodes[i].lock);
+    if (!hash_init(&open_inodes[i].inodes, inode_hash, inode_less, NULL))
+      PANIC("open inode table creation failed");
+  }
+  list_init(&readahead_queue);
+  readahead_cnt = 0;
+  lock_init(&readahead_lock);
+  cond_init(&readahead_cond);
+  thread_create("readahead", PRI_DEFAULT, readahead_thread, NULL);
+}
+
+/* Queues LENGTH bytes of INODE starting at OFFSET to be read into
+   the buffer cache in the background, along with the indirect
+   blocks that map them.  Drops the request if the read-ahead
+   thread is too far behind. */
+void inode_readahead(struct inode* inode, off_t offset, off_t length) {
+  struct readahead* ra;
+
+  lock_acquire(&readahead_lock);
+  if (readahead_cnt >= READAHEAD_QUEUE_MAX || (ra = malloc(sizeof *ra)) == NULL) {
+    lock_release(&readahead_lock);
+    return;
+  }
+  ra->inode = inode_reopen(inode);
+  ra->start = offset;
+  ra->end = offset + length;
+  list_push_back(&readahead_queue, &ra->elem);
+  readahead_cnt++;
+  cond_signal(&readahead_cond, &readahead_lock);
+  lock_release(&readahead_lock);
+}
+
+/* Serves read-ahead requests in order.  Resolving each offset
+   through byte_to_sector() pulls the indirect blocks into the
+   cache as a side effect.  The data sectors are prefetched up to
+   CACHE_PREFETCH_MAX at a time. */
+static void readahead_thread(void* aux UNUSED) {
+  for (;;) {
+    block_sector_t sectors[CACHE_PREFETCH_MAX];
+    size_t cnt = 0;
+    struct readahead* ra;
+    off_t ofs;
+
+    lock_acquire(&readahead_lock);
+    while (list_empty(&readahead_queue))
+      cond_wait(&readahead_cond, &readahead_lock);
+    ra = list_entry(list_pop_front(&readahead_queue), struct readahead, elem);
+    readahead_cnt--;
+    lock_release(&readahead_lock);
+
+    for (ofs = ra->start - ra->start % BLOCK_SECTOR_SIZE;
+         ofs < ra->end && ofs < inode_length(ra->inode); ofs += BLOCK_SECTOR_SIZE) {
+      block_sector_t sector = byte_to_sector(ra->inode, ofs);
+      if (sector != 0)
+        sectors[cnt++] = sector;
+      if (cnt == CACHE_PREFETCH_MAX) {
+        cache_prefetch(fs_device, sectors, cnt);
+        cnt = 0;
+      }
+    }
+    cache_prefetch(fs_device, sectors, cnt);
+    inode_close(ra->inode);
+    free(ra);
+  }
+}
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
@@ -250,8 +618,11 @@ bool inode_create(block_sector_t sector, off_t length, int is_dir) {
     disk_inode->length = 0;
     disk_inode->magic = INODE_MAGIC;
     disk_inode->is_dir = is_dir;
-    block_write_cached(fs_device, sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
-    success = inode_resize_unsafe(sector, length);
+    disk_inode->flags = INODE_INLINE;
+    journal_begin();
+    success = inode_resize_unsafe(disk_inode, sector, length);
+    write_disk_inode(sector, disk_inode);
+    journal_end();
     free(disk_inode);
   }
   return success;
@@ -261,50 +632,59 @@ bool inode_create(block_sector_t sector, off_t length, int is_dir) {
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode* inode_open(block_sector_t sector) {
-  struct list_elem* e;
+  struct inode_bucket* bucket = bucket_of(sector);
+  struct hash_elem* e;
   struct inode* inode;
+  struct inode_key key;
 
-  lock_acquire(&open_inodes_lock);
+  lock_acquire(&bucket->lock);
   /* Check whether this inode is already open. */
-  for (e = list_begin(&open_inodes); e != list_end(&open_inodes); e = list_next(e)) {
-    inode = list_entry(e, struct inode, elem);
-    if (inode->sector == sector) {
-      inode_reopen(inode);
-      lock_release(&open_inodes_lock);
-      return inode;
-    }
+  key.sector = sector;
+  e = hash_find(&bucket->inodes, &key.elem);
+  if (e != NULL) {
+    inode = hash_entry(e, struct inode, elem);
+    inode_reopen(inode);
+    lock_release(&bucket->lock);
+    return inode;
   }
 
   /* Allocate memory. */
   inode = malloc(sizeof *inode);
   if (inode == NULL) {
-    lock_release(&open_inodes_lock);
+    lock_release(&bucket->lock);
     return NULL;
   }
-    
+
   /* Initialize. */
-  list_push_front(&open_inodes, &inode->elem);
+  inode->sector = sector;
+  hash_insert(&bucket->inodes, &inode->elem);
   lock_init(&inode->meta_lock);
-  lock_init(&inode->lookup_lock);
+  rwlock_init(&inode->map_lock);
   lock_init(&inode->dny_w_lock);
   cond_init(&inode->dny_w_cond);
+  lock_init(&inode->dir_lock);
   lock_acquire(&inode->meta_lock);
-  inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
   inode->writers = 0;
+  inode->last_extent.length = 0;
+  inode->next_logical = 0;
+  inode->next_goal = 0;
+  inode->logged_seq = 0;
+  block_read_cached(fs_device, sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
   lock_release(&inode->meta_lock);
-  lock_release(&open_inodes_lock);
+  lock_release(&bucket->lock);
   return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode* inode_reopen(struct inode* inode) {
-  if (inode != NULL)
+  if (inode != NULL) {
     lock_acquire(&inode->meta_lock);
     inode->open_cnt++;
     lock_release(&inode->meta_lock);
+  }
   return inode;
 }
 
@@ -315,28 +695,50 @@ block_sector_t inode_get_inumber(const struct inode* inode) { return inode->sect
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
 void inode_close(struct inode* inode) {
+  struct inode_bucket* bucket;
+  block_sector_t index;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
+  /* Release resources if this was the last opener.  The bucket is
+     locked first, as in inode_open(), so that nobody can find the
+     inode between its count dropping to 0 and its removal. */
+  bucket = bucket_of(inode->sector);
+  lock_acquire(&bucket->lock);
   lock_acquire(&inode->meta_lock);
   if (--inode->open_cnt == 0) {
-    /* Remove from inode list and release lock. */
-    lock_acquire(&open_inodes_lock);
-    list_remove(&inode->elem);
-    lock_release(&open_inodes_lock);
-
-    /* Deallocate blocks if removed. */
-    if (inode->removed) {
-      inode_resize(inode, 0);
-      free_map_release(inode->sector, 1);
+    /* Remove from the open inode table and release lock. */
+    hash_delete(&bucket->inodes, &inode->elem);
+    lock_release(&bucket->lock);
+
+    /* Deallocate blocks if removed, in one journal transaction
+       with the directory's hash index, if it has one. */
+    if (!inode->removed) {
+      lock_release(&inode->meta_lock);
+      free(inode);
+      return;
     }
+    journal_begin();
+    index = inode->data.index;
+    inode_resize(inode, 0);
+    free_map_release(inode->sector, 1);
     lock_release(&inode->meta_lock);
     free(inode);
+
+    if (index != 0) {
+      struct inode* index_inode = inode_open(index);
+      if (index_inode != NULL) {
+        inode_remove(index_inode);
+        inode_close(index_inode);
+      }
+    }
+    journal_end();
     return;
   }
   lock_release(&inode->meta_lock);
+  lock_release(&bucket->lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -355,22 +757,46 @@ off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset
   uint8_t* buffer = buffer_;
   off_t bytes_read = 0;
 
+  /* Small files live in the inode.  A file never goes back to
+     being inline, so a file seen not inline can be read unlocked. */
+  if (inode->data.flags & INODE_INLINE) {
+    rwlock_acquire_read(&inode->map_lock);
+    if (inode->data.flags & INODE_INLINE) {
+      if (size > inode->data.length - offset)
+        size = inode->data.length - offset;
+      if (size > 0) {
+        memcpy(buffer, inode->data.data + offset, size);
+        bytes_read = size;
+      }
+      rwlock_release_read(&inode->map_lock);
+      return bytes_read;
+    }
+    rwlock_release_read(&inode->map_lock);
+  }
+
   while (size > 0) {
-    /* Disk sector to read, starting byte offset within sector. */
-    block_sector_t sector_idx = byte_to_sector(inode, offset);
+    /* First disk sector of the run holding OFFSET, its length,
+       and the starting byte offset within the sector.  A hole is
+       handled one sector at a time. */
+    block_sector_t run_start;
+    size_t run_cnt = byte_to_run(inode, offset, &run_start);
     int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-    /* Bytes left in inode, bytes left in sector, lesser of the two. */
+    /* Bytes left in inode, bytes left in run, lesser of the two. */
     off_t inode_left = inode_length(inode) - offset;
-    int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-    int min_left = inode_left < sector_left ? inode_left : sector_left;
+    off_t run_left = (run_cnt > 0 ? run_cnt : 1) * BLOCK_SECTOR_SIZE - sector_ofs;
+    off_t min_left = inode_left < run_left ? inode_left : run_left;
 
-    /* Number of bytes to actually copy out of this sector. */
-    int chunk_size = size < min_left ? size : min_left;
+    /* Number of bytes to actually copy out of this run. */
+    off_t chunk_size = size < min_left ? size : min_left;
     if (chunk_size <= 0)
       break;
 
-    block_read_cached(fs_device, sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+    /* Holes read as zeros. */
+    if (run_cnt == 0)
+      memset(buffer + bytes_read, 0, chunk_size);
+    else
+      cache_read_run(fs_device, run_start, sector_ofs, buffer + bytes_read, chunk_size);
 
     /* Advance. */
     size -= chunk_size;
@@ -384,11 +810,14 @@ off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   If INODE is a directory or the free map, whose data is
+   metadata, the write is one journal transaction, which logs the
+   data too.  A file's write allocates in as many transactions as
+   it needs, so that no transaction outgrows the log. */
 off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t offset) {
   const uint8_t* buffer = buffer_;
   off_t bytes_written = 0;
+  bool metadata = inode_is_dir(inode);
   /* Check in */
   lock_acquire(&inode->dny_w_lock);
   if (inode->deny_write_cnt) {
@@ -397,32 +826,57 @@ off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t
   }
   inode->writers++;
   lock_release(&inode->dny_w_lock);
-
-  if (inode_length(inode) <= offset + size) {
-    inode_resize(inode, size + offset);
+  if (metadata)
+    journal_begin();
+
+  /* Only writes that extend the file take the map lock
+     exclusively.  If the file cannot grow, write what fits. */
+  if (inode_length(inode) < offset + size && !inode_extend(inode, offset + size))
+    size = inode_length(inode) > offset ? inode_length(inode) - offset : 0;
+  /* Small files live in the inode. */
+  if (inode->data.flags & INODE_INLINE) {
+    journal_begin();
+    rwlock_acquire_write(&inode->map_lock);
+    if ((inode->data.flags & INODE_INLINE) && offset + size <= INODE_INLINE_MAX) {
+      memcpy(inode->data.data + offset, buffer, size);
+      write_inode(inode);
+      bytes_written = size;
+      size = 0;
+    }
+    rwlock_release_write(&inode->map_lock);
+    journal_end();
   }
+  /* Allocate sectors for whatever part of the range is a hole. */
+  inode_allocate(inode, offset, size);
+  if (inode->data.flags & INODE_PREALLOC)
+    claim_unwritten(inode, offset, size);
   while (size > 0) {
-    /* Sector to write, starting byte offset within sector. */
-    block_sector_t sector_idx = byte_to_sector(inode, offset);
+    /* First disk sector of the run holding OFFSET, its length,
+       and the starting byte offset within the sector. */
+    block_sector_t run_start;
+    size_t run_cnt = byte_to_run(inode, offset, &run_start);
     int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-    /* Bytes left in inode, bytes left in sector, lesser of the two. */
+    /* Bytes left in inode, bytes left in run, lesser of the two. */
     off_t inode_left = inode_length(inode) - offset;
-    int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-    int min_left = inode_left < sector_left ? inode_left : sector_left;
+    off_t run_left = run_cnt * BLOCK_SECTOR_SIZE - sector_ofs;
+    off_t min_left = inode_left < run_left ? inode_left : run_left;
 
-    /* Number of bytes to actually write into this sector. */
-    int chunk_size = size < min_left ? size : min_left;
-    if (chunk_size <= 0)
+    /* Number of bytes to actually write into this run. */
+    off_t chunk_size = size < min_left ? size : min_left;
+    if (chunk_size <= 0 || run_cnt == 0)
       break;
 
-    block_write_cached(fs_device, sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
+    cache_write_run(fs_device, run_start, sector_ofs, buffer + bytes_written, chunk_size,
+                    inode->sector, metadata);
 
     /* Advance. */
     size -= chunk_size;
     offset += chunk_size;
     bytes_written += chunk_size;
   }
+  if (metadata)
+    journal_end();
   /* Check out */
   lock_acquire(&inode->dny_w_lock);
   inode->writers--;
@@ -453,8 +907,21 @@ void inode_allow_write(struct inode* inode) {
 }
 
 /* Returns the length, in bytes, of INODE's data. */
-off_t inode_length(const struct inode* inode) {
-  off_t result;
-  block_read_cached(fs_device, inode->sector, &result, 0, sizeof(off_t)); 
-  return result;
+off_t inode_length(const struct inode* inode) { return inode->data.length; }
+
+/* Returns true if INODE is a directory. */
+bool inode_is_dir(const struct inode* inode) { return inode->data.is_dir != 0; }
+
+/* Returns the sector of directory INODE's hash index, or 0 if it
+   has none and its entries must be searched in order. */
+block_sector_t inode_get_index(const struct inode* inode) { return inode->data.index; }
+
+/* Records SECTOR as the hash index of directory INODE. */
+void inode_set_index(struct inode* inode, block_sector_t sector) {
+  journal_begin();
+  rwlock_acquire_write(&inode->map_lock);
+  inode->data.index = sector;
+  write_inode(inode);
+  rwlock_release_write(&inode->map_lock);
+  journal_end();
 }
@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
+#include <hash.h>
+#include "filesys/extent.h"
 #include "threads/synch.h"
 
 
@@ -11,41 +13,57 @@ struct bitmap;
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
-#define DIRECT_MAX 123 * 512
-#define INDIRECT_MAX 123 * 512 + 128 * 512
-#define DOUBLE_MAX 123 * 512 + 128 * 512 + 128 * 128 * 512
+
+/* inode_disk flags. */
+#define INODE_INLINE 0x1   /* Contents are stored in the inode itself. */
+#define INODE_PREALLOC 0x2 /* Extents may have unwritten sectors. */
+
+/* Largest file that can be stored inline. */
+#define INODE_INLINE_MAX ((off_t)sizeof(struct extent_root))
 
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk {
-  off_t length;         /* File size in bytes. */
+  off_t length;               /* File size in bytes. */
   int is_dir;
-  unsigned magic;       /* Magic number. */
-  block_sector_t direct[123];       /* 124 direct pointer */
-  block_sector_t indirect;          /* indirect_pointer */
-  block_sector_t double_indirect;   /* double_indirect_pointer */
+  unsigned magic;             /* Magic number. */
+  uint32_t flags;             /* INODE_* flags. */
+  block_sector_t index;       /* Directory's hash index inode, or 0. */
+  uint32_t unused[2];         /* Not used. */
+  union {
+    struct extent_root extents;     /* Where the file's sectors are. */
+    uint8_t data[INODE_INLINE_MAX]; /* Contents, if INODE_INLINE. */
+  };
 };
 
 
 /* In-memory inode. */
 struct inode {
-  struct list_elem elem;  /* Element in inode list. */
+  struct hash_elem elem;  /* Element in the open inode table. */
   block_sector_t sector;  /* Sector number of disk location. */
   int open_cnt;           /* Number of openers. */
   bool removed;           /* True if deleted, false otherwise. */
   int deny_write_cnt;     /* 0: writes ok, >0: deny writes. */
-  struct lock lookup_lock;/* Lock for lookup the inode disk */
+  struct rwlock map_lock;  /* Lock for the block map: shared to look up, exclusive to change. */
   struct lock meta_lock;  /* Lock for inode metadata */
   struct lock dny_w_lock; /* Lock for deny write cnt */
   struct condition dny_w_cond; /* Condition variable for deny write cnt */
   int writers;            /* Indicate  */
   struct lock dir_lock ;   /* Lock on directory */
+  struct inode_disk data; /* Copy of the on-disk inode, under map_lock. */
+  struct extent last_extent; /* Extent last looked up; see byte_to_sector(). */
+  uint32_t next_logical;     /* File sector after the last run allocated. */
+  block_sector_t next_goal;  /* Disk sector after that run; see allocate_range(). */
+  uint32_t logged_seq;       /* Journal transaction that last changed DATA. */
 };
 
 static inline size_t bytes_to_sectors(off_t size);
-static block_sector_t byte_to_sector(const struct inode* inode, off_t pos);
-bool inode_resize_unsafe(block_sector_t id_sector, off_t size);
+static block_sector_t byte_to_sector(struct inode* inode, off_t pos);
+bool inode_resize_unsafe(struct inode_disk* id, block_sector_t sector, off_t size);
 bool inode_resize(struct inode* inode, off_t size);
+bool inode_allocate(struct inode* inode, off_t offset, off_t length);
+bool inode_preallocate(struct inode* inode, off_t offset, off_t length);
+bool inode_sync(struct inode* inode, bool data_only);
 void inode_init(void);
 bool inode_create(block_sector_t sector, off_t length, int is_dir);
 struct inode* inode_open(block_sector_t sector);
@@ -58,5 +76,9 @@ off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t
 void inode_deny_write(struct inode* inode);
 void inode_allow_write(struct inode* inode);
 off_t inode_length(const struct inode* inode);
+bool inode_is_dir(const struct inode* inode);
+block_sector_t inode_get_index(const struct inode* inode);
+void inode_set_index(struct inode* inode, block_sector_t sector);
+void inode_readahead(struct inode* inode, off_t offset, off_t length);
 
 #endif /* filesys/inode.h */
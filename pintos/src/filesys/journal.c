@@ -0,0 +1,280 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Metadata journal.  Every change to an inode, an extent tree
+   block, a directory's entries or the free map is made within a
+   transaction bracketed by journal_begin() and journal_end(), and
+   the sectors it modifies are marked logged in the buffer cache,
+   which keeps them from being written back on their own.
+
+   Transactions are committed as a group: journal_commit() waits
+   for the operations in progress to end, then writes every logged
+   sector to the log in one request, followed by their home
+   locations, and only then lets them be written back again.  A
+   crash at any point leaves either the old or the new version of
+   each group complete on disk, once journal_init() has replayed a
+   log that was committed but not finished.
+
+   File data is not journaled, but it is ordered: each commit
+   first writes back the data sectors that its transaction newly
+   mapped, so that committed metadata never points at sectors still
+   holding someone else's old data.  Other dirty data is left to
+   the cache's flusher. */
+
+/* Identify the journal header and descriptor. */
+#define HEADER_MAGIC 0x4a524e4c
+#define DESC_MAGIC 0x4a444553
+
+/* Journal header, in sector JOURNAL_SECTOR. */
+struct journal_header {
+  unsigned magic;      /* HEADER_MAGIC. */
+  uint32_t generation; /* Number of unclean mounts so far. */
+  uint32_t clean;      /* Nonzero if unmounted cleanly. */
+  uint32_t done_seq;   /* Last transaction written home. */
+  uint8_t unused[BLOCK_SECTOR_SIZE - 16];
+};
+
+/* Transaction descriptor, in the sector after the header.  The
+   images of the logged sectors follow it, in the same order. */
+struct journal_desc {
+  unsigned magic;     /* DESC_MAGIC. */
+  uint32_t seq;       /* Transaction number. */
+  uint32_t cnt;       /* Number of sectors logged. */
+  uint32_t checksum;  /* hash_bytes() of the CNT images. */
+  block_sector_t sectors[JOURNAL_LOG_MAX]; /* Home sectors, ascending. */
+};
+
+static struct journal_header header;
+static struct lock journal_lock;
+static struct condition journal_cond; /* Signalled when ACTIVE or COMMITTING drops. */
+static int active;                    /* Operations in the running transaction. */
+static bool committing;               /* Commit in progress? */
+static size_t tx_limit;               /* Most sectors a transaction may log. */
+static size_t map_sectors;            /* Free map sectors a commit may log. */
+static uint32_t tx_seq;               /* Number of the running transaction. */
+
+/* Staging area for a commit or replay: the descriptor, then up to
+   JOURNAL_LOG_MAX sector images. */
+static uint8_t* log_buf;
+static const void* log_bufs[JOURNAL_SECTORS - 1];
+
+static void write_log(void);
+static void write_home(const struct journal_desc*);
+static void replay(void);
+static int compare_sectors(const void* a, const void* b);
+
+/* Initializes the journal.  If FORMAT is true, creates an empty
+   one; otherwise, if the file system was not unmounted cleanly,
+   finishes the last transaction committed to the log.  Must be
+   called before anything else reads the file system. */
+void journal_init(bool format) {
+  size_t i;
+
+  ASSERT(sizeof header == BLOCK_SECTOR_SIZE);
+  ASSERT(sizeof(struct journal_desc) == BLOCK_SECTOR_SIZE);
+
+  lock_init(&journal_lock);
+  cond_init(&journal_cond);
+  active = 0;
+  committing = false;
+  tx_seq = 1;
+  log_buf = palloc_get_multiple(0, DIV_ROUND_UP((JOURNAL_SECTORS - 1) * BLOCK_SECTOR_SIZE, PGSIZE));
+  if (log_buf == NULL)
+    PANIC("not enough memory for the journal");
+  for (i = 0; i < JOURNAL_SECTORS - 1; i++)
+    log_bufs[i] = log_buf + i * BLOCK_SECTOR_SIZE;
+
+  /* Logged sectors cannot be evicted, so leave half the cache for
+     everything else.  A transaction must still hold one operation
+     and the whole free map. */
+  tx_limit = cache_size / 2 < JOURNAL_LOG_MAX ? cache_size / 2 : JOURNAL_LOG_MAX;
+  map_sectors = free_map_file_sectors();
+  if (map_sectors + JOURNAL_OP_MAX > tx_limit)
+    PANIC("disk too large for a %zu-sector buffer cache; use a larger -cache-size", cache_size);
+
+  if (format) {
+    memset(&header, 0, sizeof header);
+    header.magic = HEADER_MAGIC;
+    memset(log_buf, 0, BLOCK_SECTOR_SIZE);
+    block_write(fs_device, JOURNAL_SECTOR + 1, log_buf);
+  } else {
+    block_read(fs_device, JOURNAL_SECTOR, &header);
+    if (header.magic != HEADER_MAGIC)
+      PANIC("file system has no journal; reformat it with -f");
+    if (!header.clean) {
+      replay();
+      header.generation++;
+    }
+  }
+  header.clean = false;
+  block_write(fs_device, JOURNAL_SECTOR, &header);
+}
+
+/* Marks the file system clean.  The buffer cache must have been
+   flushed. */
+void journal_done(void) {
+  header.clean = true;
+  block_write(fs_device, JOURNAL_SECTOR, &header);
+}
+
+/* Returns the number of times the file system has been mounted
+   after a crash.  Anything on disk that is not journaled and was
+   written in an earlier generation may not match the metadata. */
+uint32_t journal_generation(void) { return header.generation; }
+
+/* Returns the number of the running transaction, which changes
+   with every commit.  Stable within a transaction. */
+uint32_t journal_seq(void) { return tx_seq; }
+
+/* Starts an operation that modifies metadata, joining the running
+   transaction.  Waits while a commit is in progress, and commits
+   first unless the transaction has room for JOURNAL_OP_MAX more
+   sectors from this operation and from each one already in it, on
+   top of the free map sectors that the commit adds.  A transaction
+   therefore always fits the log, and its logged sectors never fill
+   the cache.  Calls nest: only the outermost pair of calls
+   counts. */
+void journal_begin(void) {
+  struct thread* t = thread_current();
+
+  if (t->journal_depth++ > 0)
+    return;
+  lock_acquire(&journal_lock);
+  for (;;) {
+    if (committing) {
+      cond_wait(&journal_cond, &journal_lock);
+    } else if (cache_logged_cnt() + map_sectors + (active + 1) * JOURNAL_OP_MAX > tx_limit) {
+      lock_release(&journal_lock);
+      t->journal_depth--;
+      journal_commit();
+      t->journal_depth++;
+      lock_acquire(&journal_lock);
+    } else {
+      break;
+    }
+  }
+  active++;
+  lock_release(&journal_lock);
+}
+
+/* Ends an operation started with journal_begin(). */
+void journal_end(void) {
+  struct thread* t = thread_current();
+
+  ASSERT(t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+  lock_acquire(&journal_lock);
+  if (--active == 0)
+    cond_broadcast(&journal_cond, &journal_lock);
+  lock_release(&journal_lock);
+}
+
+/* Commits the running transaction: waits for the operations in it
+   to end, holding off new ones, writes back the file data sectors
+   they allocated, and then writes everything they logged, along
+   with the free map, to the log and then home.  Must not be called
+   within a transaction. */
+void journal_commit(void) {
+  struct thread* t = thread_current();
+
+  ASSERT(t->journal_depth == 0);
+  lock_acquire(&journal_lock);
+  while (committing)
+    cond_wait(&journal_cond, &journal_lock);
+  committing = true;
+  while (active > 0)
+    cond_wait(&journal_cond, &journal_lock);
+  lock_release(&journal_lock);
+
+  /* Bring the free map file up to date as part of the transaction,
+     so that it matches the metadata committed with it. */
+  t->journal_depth++;
+  free_map_flush();
+  t->journal_depth--;
+  cache_write_ordered();
+  write_log();
+
+  lock_acquire(&journal_lock);
+  tx_seq++;
+  committing = false;
+  cond_broadcast(&journal_cond, &journal_lock);
+  lock_release(&journal_lock);
+}
+
+/* Writes every logged sector to the log, in one request, and then
+   home.  journal_begin() keeps a transaction within the log. */
+static void write_log(void) {
+  struct journal_desc* desc = (struct journal_desc*)log_buf;
+  size_t cnt = cache_logged(desc->sectors, JOURNAL_LOG_MAX);
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  ASSERT(cnt <= JOURNAL_LOG_MAX);
+  qsort(desc->sectors, cnt, sizeof *desc->sectors, compare_sectors);
+  for (i = 0; i < cnt; i++)
+    cache_peek(fs_device, desc->sectors[i], log_buf + (i + 1) * BLOCK_SECTOR_SIZE);
+  desc->magic = DESC_MAGIC;
+  desc->seq = header.done_seq + 1;
+  desc->cnt = cnt;
+  desc->checksum = hash_bytes(log_buf + BLOCK_SECTOR_SIZE, cnt * BLOCK_SECTOR_SIZE);
+  block_writev(fs_device, JOURNAL_SECTOR + 1, log_bufs, cnt + 1);
+  write_home(desc);
+  for (i = 0; i < cnt; i++)
+    cache_checkpointed(desc->sectors[i]);
+  header.done_seq = desc->seq;
+  block_write(fs_device, JOURNAL_SECTOR, &header);
+}
+
+/* Writes the images staged in log_buf to the sectors DESC names,
+   which are in ascending order, one request per run of
+   consecutive sectors. */
+static void write_home(const struct journal_desc* desc) {
+  size_t i, n;
+
+  for (i = 0; i < desc->cnt; i += n) {
+    for (n = 1; i + n < desc->cnt; n++)
+      if (desc->sectors[i + n] != desc->sectors[i] + n)
+        break;
+    block_writev(fs_device, desc->sectors[i], log_bufs + i + 1, n);
+  }
+}
+
+/* Writes home the transaction in the log, if it was committed
+   completely and never written home. */
+static void replay(void) {
+  struct journal_desc* desc = (struct journal_desc*)log_buf;
+
+  block_read(fs_device, JOURNAL_SECTOR + 1, desc);
+  if (desc->magic != DESC_MAGIC || desc->seq != header.done_seq + 1 || desc->cnt == 0 ||
+      desc->cnt > JOURNAL_LOG_MAX)
+    return;
+  block_readv(fs_device, JOURNAL_SECTOR + 2, (void**)log_bufs + 1, desc->cnt);
+  if (hash_bytes(log_buf + BLOCK_SECTOR_SIZE, desc->cnt * BLOCK_SECTOR_SIZE) != desc->checksum)
+    return;
+
+  printf("Replaying journal: %u sectors...", (unsigned)desc->cnt);
+  write_home(desc);
+  header.done_seq = desc->seq;
+  printf("done.\n");
+}
+
+/* Orders block_sector_t values for qsort(). */
+static int compare_sectors(const void* a_, const void* b_) {
+  const block_sector_t* a = a_;
+  const block_sector_t* b = b_;
+  return *a < *b ? -1 : *a > *b;
+}
@@ -0,0 +1,32 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/block.h"
+
+/* Most sectors one transaction can log: as many as its descriptor
+   sector has room to name. */
+#define JOURNAL_LOG_MAX ((BLOCK_SECTOR_SIZE - 16) / sizeof(block_sector_t))
+
+/* Most sectors, besides the free map's, that one operation may
+   log.  An operation does not start unless the running transaction
+   has room for that many more, so an operation that could log
+   more must split itself into several. */
+#define JOURNAL_OP_MAX 16
+
+/* The journal occupies JOURNAL_SECTORS sectors of the file system
+   device starting at JOURNAL_SECTOR: a header, a descriptor, and
+   room for the images of up to JOURNAL_LOG_MAX sectors. */
+#define JOURNAL_SECTOR 2
+#define JOURNAL_SECTORS (JOURNAL_LOG_MAX + 2)
+
+void journal_init(bool format);
+void journal_done(void);
+void journal_begin(void);
+void journal_end(void);
+void journal_commit(void);
+uint32_t journal_generation(void);
+uint32_t journal_seq(void);
+
+#endif /* filesys/journal.h */
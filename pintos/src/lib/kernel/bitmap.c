@@ -50,6 +50,47 @@ static inline elem_type last_mask(const struct bitmap* b) {
   return last_bits ? ((elem_type)1 << last_bits) - 1 : (elem_type)-1;
 }
 
+/* Returns an elem_type with the CNT bits starting at bit OFS
+   turned on.  OFS + CNT must not exceed ELEM_BITS. */
+static inline elem_type range_mask(size_t ofs, size_t cnt) {
+  elem_type mask = cnt < ELEM_BITS ? ((elem_type)1 << cnt) - 1 : (elem_type)-1;
+  return mask << ofs;
+}
+
+/* Returns the number of bits set in E, which must be 32 bits
+   wide.  Counts in parallel within the element: the kernel has
+   no libgcc to back __builtin_popcount(), and the 80x86 has no
+   population count instruction before SSE4.2. */
+static inline size_t elem_popcount(elem_type e) {
+  e = e - ((e >> 1) & 0x55555555);
+  e = (e & 0x33333333) + ((e >> 2) & 0x33333333);
+  e = (e + (e >> 4)) & 0x0f0f0f0f;
+  return (e * 0x01010101) >> 24;
+}
+
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or B's size if there is none.  Skips whole
+   elements that have no such bit, then locates the bit within an
+   element with a single bit scan (BSF). */
+static size_t next_bit(const struct bitmap* b, size_t start, bool value) {
+  elem_type flip = value ? 0 : (elem_type)-1;
+  size_t idx = elem_idx(start);
+  size_t last = elem_cnt(b->bit_cnt);
+  elem_type e;
+  size_t bit;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+  e = (b->bits[idx] ^ flip) & ~(bit_mask(start) - 1);
+  while (e == 0) {
+    if (++idx >= last)
+      return b->bit_cnt;
+    e = b->bits[idx] ^ flip;
+  }
+  bit = idx * ELEM_BITS + __builtin_ctzl(e);
+  return bit < b->bit_cnt ? bit : b->bit_cnt;
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -165,46 +206,68 @@ void bitmap_set_all(struct bitmap* b, bool value) {
   bitmap_set_multiple(b, 0, bitmap_size(b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Works an element at a time; each element is updated
+   atomically. */
 void bitmap_set_multiple(struct bitmap* b, size_t start, size_t cnt, bool value) {
-  size_t i;
+  size_t end = start + cnt;
 
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set(b, start + i, value);
+  while (start < end) {
+    size_t ofs = start % ELEM_BITS;
+    size_t n = ELEM_BITS - ofs < end - start ? ELEM_BITS - ofs : end - start;
+    elem_type mask = range_mask(ofs, n);
+    elem_type* e = &b->bits[elem_idx(start)];
+
+    /* Atomic on a uniprocessor, as in bitmap_mark() and
+       bitmap_reset(). */
+    if (value)
+      asm("orl %1, %0" : "=m"(*e) : "r"(mask) : "cc");
+    else
+      asm("andl %1, %0" : "=m"(*e) : "r"(~mask) : "cc");
+    start += n;
+  }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t bitmap_count(const struct bitmap* b, size_t start, size_t cnt, bool value) {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t set_cnt = 0;
 
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test(b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  while (start < end) {
+    size_t ofs = start % ELEM_BITS;
+    size_t n = ELEM_BITS - ofs < end - start ? ELEM_BITS - ofs : end - start;
+    set_cnt += elem_popcount(b->bits[elem_idx(start)] & range_mask(ofs, n));
+    start += n;
+  }
+  return value ? set_cnt : cnt - set_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool bitmap_contains(const struct bitmap* b, size_t start, size_t cnt, bool value) {
-  size_t i;
+  elem_type flip = value ? 0 : (elem_type)-1;
+  size_t end = start + cnt;
 
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test(b, start + i) == value)
+  while (start < end) {
+    size_t ofs = start % ELEM_BITS;
+    size_t n = ELEM_BITS - ofs < end - start ? ELEM_BITS - ofs : end - start;
+    if ((b->bits[elem_idx(start)] ^ flip) & range_mask(ofs, n))
       return true;
+    start += n;
+  }
   return false;
 }
 
@@ -231,17 +294,30 @@ bool bitmap_all(const struct bitmap* b, size_t start, size_t cnt) {
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+   Jumps from each run of VALUE bits to the next, finding both
+   ends of a run with next_bit(), so it takes time proportional to
+   the number of elements and runs rather than bits. */
 size_t bitmap_scan(const struct bitmap* b, size_t start, size_t cnt, bool value) {
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) {
     size_t last = b->bit_cnt - cnt;
-    size_t i;
-    for (i = start; i <= last; i++)
-      if (!bitmap_contains(b, i, cnt, !value))
+    size_t i = start;
+    while (i <= last) {
+      size_t end;
+
+      i = next_bit(b, i, value);
+      if (i > last)
+        break;
+      end = next_bit(b, i, !value);
+      if (end - i >= cnt)
         return i;
+      i = end;
+    }
   }
   return BITMAP_ERROR;
 }
@@ -284,6 +360,19 @@ bool bitmap_write(const struct bitmap* b, struct file* file) {
   off_t size = byte_cnt(b->bit_cnt);
   return file_write_at(file, b->bits, size, 0) == size;
 }
+
+/* Writes the SIZE bytes of B's file image that start at byte OFS
+   to the same place in FILE, stopping at the end of the image.
+   Lets a caller that tracks which parts of B changed rewrite only
+   those.  Returns true if successful, false otherwise. */
+bool bitmap_write_bytes(const struct bitmap* b, struct file* file, size_t ofs, size_t size) {
+  size_t total = byte_cnt(b->bit_cnt);
+
+  ASSERT(ofs <= total);
+  if (size > total - ofs)
+    size = total - ofs;
+  return file_write_at(file, (const uint8_t*)b->bits + ofs, size, ofs) == (off_t)size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
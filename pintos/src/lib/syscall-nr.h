@@ -31,7 +31,11 @@ enum {
   SYS_INUMBER,  /* Returns the inode number for a fd. */
   SYS_HITRATE,  /* Returns the number of cache hits */
   SYS_FLUSHCACHE, /* Flush the cache */
-  SYS_BLOCKWCNT /* Get the block write cnt */
+  SYS_BLOCKWCNT, /* Get the block write cnt */
+  SYS_FALLOCATE, /* Reserve disk space for part of a file. */
+  SYS_GETDENTS,  /* Reads many directory entries at once. */
+  SYS_FSYNC,     /* Writes a file and all metadata to disk. */
+  SYS_FDATASYNC  /* Writes a file's data and mapping to disk. */
 };
 
 #endif /* lib/syscall-nr.h */
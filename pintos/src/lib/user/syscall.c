@@ -70,6 +70,22 @@ unsigned long long get_block_wcnt(void) {
   return syscall0(SYS_BLOCKWCNT);
 }
 
+bool fallocate(int fd, unsigned offset, unsigned length) {
+  return syscall3(SYS_FALLOCATE, fd, offset, length);
+}
+
+int getdents(int fd, struct dirent* entries, unsigned size) {
+  return syscall3(SYS_GETDENTS, fd, entries, size);
+}
+
+bool fsync(int fd) {
+  return syscall1(SYS_FSYNC, fd);
+}
+
+bool fdatasync(int fd) {
+  return syscall1(SYS_FDATASYNC, fd);
+}
+
 void exit(int status) {
   syscall1(SYS_EXIT, status);
   NOT_REACHED();
@@ -15,6 +15,13 @@ typedef int mapid_t;
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* A directory entry, as read by getdents(). */
+struct dirent {
+  int inumber;                     /* Inode number. */
+  bool is_dir;                     /* Is it a directory? */
+  char name[READDIR_MAX_LEN + 1];  /* Null terminated file name. */
+};
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0 /* Successful execution. */
 #define EXIT_FAILURE 1 /* Unsuccessful execution. */
@@ -48,5 +55,9 @@ int inumber(int fd);
 int hit_rate(void);
 int flush_cache(void);
 unsigned long long get_block_wcnt(void);
+bool fallocate(int fd, unsigned offset, unsigned length);
+int getdents(int fd, struct dirent* entries, unsigned size);
+bool fsync(int fd);
+bool fdatasync(int fd);
 
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,20 @@
+/* Runs the cache-scan workload with plain LRU replacement (see
+   Make.tests).  LRU lets the streaming read push the hot files'
+   sectors out, so the check that cache-scan relies on must see
+   misses here; if it did not, cache-scan would prove nothing. */
+
+#include <syscall.h>
+#include "tests/filesys/scan-test.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  quiet = true;
+  bool all_hits = scan_test();
+  quiet = false;
+
+  if (all_hits)
+    fail("hot sectors survived streaming read under LRU");
+  else
+    msg("hot sectors lost to streaming read");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(cache-scan-lru) begin
+(cache-scan-lru) hot sectors lost to streaming read
+(cache-scan-lru) end
+cache-scan-lru: exit(0)
+EOF
+pass;
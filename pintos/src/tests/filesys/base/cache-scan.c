@@ -0,0 +1,20 @@
+/* Makes a few small files hot in the buffer cache, then streams
+   a file larger than the cache through it, and checks that every
+   re-read of the hot files' sectors afterward is a cache hit,
+   that is, the one-touch streaming data did not flush them out. */
+
+#include <syscall.h>
+#include "tests/filesys/scan-test.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  quiet = true;
+  bool all_hits = scan_test();
+  quiet = false;
+
+  if (all_hits)
+    msg("hot sectors survived streaming read");
+  else
+    fail("hot sectors lost to streaming read");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(cache-scan) begin
+(cache-scan) hot sectors survived streaming read
+(cache-scan) end
+cache-scan: exit(0)
+EOF
+pass;
@@ -0,0 +1,50 @@
+/* Creates hundreds of files spread over a few directories and
+   keeps them all open, then opens each one a second time and
+   checks that both descriptors refer to the same inode.  Each
+   second open must find its inode among all 512 that are open,
+   which the kernel's open inode table makes a hash lookup rather
+   than a scan. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DIR_CNT 8
+#define FILES_PER_DIR 64
+#define FILE_CNT (DIR_CNT * FILES_PER_DIR)
+
+static int fds[FILE_CNT];
+
+/* Stores the name of file I in NAME. */
+static void file_name(int i, char name[16]) {
+  snprintf(name, 16, "d%d/f%d", i / FILES_PER_DIR, i % FILES_PER_DIR);
+}
+
+void test_main(void) {
+  char name[16];
+  int i;
+
+  quiet = true;
+  for (i = 0; i < DIR_CNT; i++) {
+    snprintf(name, sizeof name, "d%d", i);
+    CHECK(mkdir(name), "mkdir \"%s\"", name);
+  }
+  for (i = 0; i < FILE_CNT; i++) {
+    file_name(i, name);
+    CHECK(create(name, 0), "create \"%s\"", name);
+    CHECK((fds[i] = open(name)) > 1, "open \"%s\"", name);
+  }
+  for (i = 0; i < FILE_CNT; i++) {
+    int fd;
+    file_name(i, name);
+    CHECK((fd = open(name)) > 1, "open \"%s\" again", name);
+    CHECK(inumber(fd) == inumber(fds[i]), "inumber \"%s\"", name);
+    close(fd);
+  }
+  for (i = 0; i < FILE_CNT; i++)
+    close(fds[i]);
+  quiet = false;
+
+  msg("opened %d files twice", FILE_CNT);
+}
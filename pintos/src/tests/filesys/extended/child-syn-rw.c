@@ -5,7 +5,10 @@
    bytes, because the file has not grown in the meantime.  That
    is, we are "busy waiting" for the file to grow.
    (This test could be improved by adding a "yield" system call
-   and calling yield whenever we receive a 0-byte read.) */
+   and calling yield whenever we receive a 0-byte read.)
+   Once the file is complete, we read all of it REREAD_CNT more
+   times, so that the children end up reading the same, fully
+   allocated file in parallel. */
 
 #include <random.h>
 #include <stdlib.h>
@@ -22,6 +25,7 @@ int main(int argc, const char* argv[]) {
   int child_idx;
   int fd;
   size_t ofs;
+  int i;
 
   quiet = true;
 
@@ -43,6 +47,12 @@ int main(int argc, const char* argv[]) {
       ofs += bytes_read;
     }
   }
+
+  for (i = 0; i < REREAD_CNT; i++) {
+    seek(fd, 0);
+    CHECK(read(fd, buf2, sizeof buf2) == (int)sizeof buf2, "reread %d of \"%s\"", i, file_name);
+    compare_bytes(buf2, buf1, sizeof buf2, 0, file_name);
+  }
   close(fd);
 
   return child_idx;
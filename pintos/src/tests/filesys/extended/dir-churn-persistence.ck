@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($tree);
+for (my $d = 0; $d < 7; $d++) {
+    for (my $f = 0; $f < 40; $f += 2) {
+        $tree->{"d$d"}{"f$f"} = ["d$d/f$f"];
+    }
+}
+check_archive ($tree);
+pass;
@@ -0,0 +1,54 @@
+/* Creates, writes and removes hundreds of files and directories in
+   quick succession, far more metadata changes than one journal
+   transaction holds, so that they are committed in many groups.
+   The persistence check makes sure every surviving change, and
+   none of the removed ones, reached the disk. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DIR_CNT 8
+#define FILE_CNT 40
+
+void test_main(void) {
+  char name[32];
+  int fd;
+  int d, f;
+
+  msg("creating d0 through d%d, each with f0 through f%d...", DIR_CNT - 1, FILE_CNT - 1);
+  quiet = true;
+  for (d = 0; d < DIR_CNT; d++) {
+    snprintf(name, sizeof name, "d%d", d);
+    CHECK(mkdir(name), "mkdir \"%s\"", name);
+    for (f = 0; f < FILE_CNT; f++) {
+      snprintf(name, sizeof name, "d%d/f%d", d, f);
+      CHECK(create(name, 0), "create \"%s\"", name);
+      CHECK((fd = open(name)) > 1, "open \"%s\"", name);
+      CHECK(write(fd, name, strlen(name)) == (int)strlen(name), "write \"%s\"", name);
+      close(fd);
+    }
+  }
+  quiet = false;
+
+  msg("removing odd-numbered files...");
+  quiet = true;
+  for (d = 0; d < DIR_CNT; d++)
+    for (f = 1; f < FILE_CNT; f += 2) {
+      snprintf(name, sizeof name, "d%d/f%d", d, f);
+      CHECK(remove(name), "remove \"%s\"", name);
+    }
+  quiet = false;
+
+  msg("removing d%d...", DIR_CNT - 1);
+  quiet = true;
+  for (f = 0; f < FILE_CNT; f += 2) {
+    snprintf(name, sizeof name, "d%d/f%d", DIR_CNT - 1, f);
+    CHECK(remove(name), "remove \"%s\"", name);
+  }
+  snprintf(name, sizeof name, "d%d", DIR_CNT - 1);
+  CHECK(remove(name), "rmdir \"%s\"", name);
+  quiet = false;
+}
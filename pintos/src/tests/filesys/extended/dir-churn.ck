@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-churn) begin
+(dir-churn) creating d0 through d7, each with f0 through f39...
+(dir-churn) removing odd-numbered files...
+(dir-churn) removing d7...
+(dir-churn) end
+EOF
+pass;
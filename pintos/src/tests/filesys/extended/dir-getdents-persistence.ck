@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($d);
+$d->{"f$_"} = [''] foreach 0...49;
+$d->{"s$_"} = {} foreach 0...9;
+check_archive ({"d" => $d});
+pass;
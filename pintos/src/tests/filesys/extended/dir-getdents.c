@@ -0,0 +1,66 @@
+/* Fills a directory with files and subdirectories, then reads it
+   back with getdents() a few entries at a time and checks that
+   each entry appears once, with the right type and inumber. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 50
+#define DIR_CNT 10
+
+void test_main(void) {
+  struct dirent entries[4];
+  bool seen[FILE_CNT + DIR_CNT];
+  char name[32];
+  int dir_fd, cnt, total, i;
+
+  CHECK(mkdir("d"), "mkdir \"d\"");
+  msg("creating d/f0 through d/f%d and d/s0 through d/s%d...", FILE_CNT - 1, DIR_CNT - 1);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++) {
+    snprintf(name, sizeof name, "d/f%d", i);
+    CHECK(create(name, 0), "create \"%s\"", name);
+  }
+  for (i = 0; i < DIR_CNT; i++) {
+    snprintf(name, sizeof name, "d/s%d", i);
+    CHECK(mkdir(name), "mkdir \"%s\"", name);
+  }
+  quiet = false;
+
+  CHECK((dir_fd = open("d")) > 1, "open \"d\"");
+  msg("reading entries of \"d\"...");
+  memset(seen, 0, sizeof seen);
+  total = 0;
+  while ((cnt = getdents(dir_fd, entries, sizeof entries)) > 0) {
+    if (cnt > 4)
+      fail("getdents returned %d entries for a buffer of 4", cnt);
+    for (i = 0; i < cnt; i++) {
+      struct dirent* e = &entries[i];
+      bool is_dir = e->name[0] == 's';
+      int n = atoi(e->name + 1) + (is_dir ? FILE_CNT : 0);
+      int fd;
+
+      if ((e->name[0] != 'f' && !is_dir) || n >= FILE_CNT + DIR_CNT || seen[n])
+        fail("unexpected entry \"%s\"", e->name);
+      seen[n] = true;
+      if (e->is_dir != is_dir)
+        fail("\"%s\" has the wrong type", e->name);
+
+      snprintf(name, sizeof name, "d/%s", e->name);
+      fd = open(name);
+      if (fd < 2 || inumber(fd) != e->inumber)
+        fail("\"%s\" has the wrong inumber", e->name);
+      close(fd);
+      total++;
+    }
+  }
+  CHECK(cnt == 0, "getdents at end of \"d\"");
+  if (total != FILE_CNT + DIR_CNT)
+    fail("read %d entries, expected %d", total, FILE_CNT + DIR_CNT);
+  msg("read %d entries", total);
+  close(dir_fd);
+}
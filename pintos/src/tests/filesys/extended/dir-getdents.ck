@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "d"
+(dir-getdents) creating d/f0 through d/f49 and d/s0 through d/s9...
+(dir-getdents) open "d"
+(dir-getdents) reading entries of "d"...
+(dir-getdents) getdents at end of "d"
+(dir-getdents) read 60 entries
+(dir-getdents) end
+EOF
+pass;
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($many);
+for (my $i = 0; $i < 20000; $i += 1000) {
+    $many->{"f$i"} = [''];
+}
+check_archive ({"many" => $many});
+pass;
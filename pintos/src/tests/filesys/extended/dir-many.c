@@ -0,0 +1,58 @@
+/* Creates tens of thousands of files in a single directory, looks
+   each one up, then removes all but every thousandth.  With entries
+   searched one by one this takes time quadratic in the number of
+   files; the directory's hash index keeps it linear. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 20000
+#define KEEP_EVERY 1000
+
+void test_main(void) {
+  char name[32];
+  int fd;
+  int i;
+
+  CHECK(mkdir("many"), "mkdir \"many\"");
+  CHECK(chdir("many"), "chdir \"many\"");
+
+  msg("creating f0 through f%d...", FILE_CNT - 1);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++) {
+    snprintf(name, sizeof name, "f%d", i);
+    CHECK(create(name, 0), "create \"%s\"", name);
+  }
+  quiet = false;
+
+  msg("opening each file...");
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++) {
+    snprintf(name, sizeof name, "f%d", i);
+    CHECK((fd = open(name)) > 1, "open \"%s\"", name);
+    close(fd);
+  }
+  quiet = false;
+
+  msg("removing all but every %dth file...", KEEP_EVERY);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    if (i % KEEP_EVERY != 0) {
+      snprintf(name, sizeof name, "f%d", i);
+      CHECK(remove(name), "remove \"%s\"", name);
+    }
+  for (i = 0; i < FILE_CNT; i++) {
+    snprintf(name, sizeof name, "f%d", i);
+    fd = open(name);
+    if (i % KEEP_EVERY == 0) {
+      CHECK(fd > 1, "open \"%s\"", name);
+      close(fd);
+    } else
+      CHECK(fd == -1, "open \"%s\" after removing it", name);
+  }
+  quiet = false;
+
+  CHECK(chdir("/"), "chdir \"/\"");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-many) begin
+(dir-many) mkdir "many"
+(dir-many) chdir "many"
+(dir-many) creating f0 through f19999...
+(dir-many) opening each file...
+(dir-many) removing all but every 1000th file...
+(dir-many) chdir "/"
+(dir-many) end
+EOF
+pass;
@@ -0,0 +1,32 @@
+/* Looks up the same paths before and after the directories and
+   files along them are created, removed and recreated, to make
+   sure that no remembered lookup outlives the entry it found or
+   the absence of one. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  int fd;
+
+  CHECK(open("a/b/c") == -1, "open \"a/b/c\" (must return -1)");
+  CHECK(mkdir("a"), "mkdir \"a\"");
+  CHECK(mkdir("a/b"), "mkdir \"a/b\"");
+  CHECK(open("a/b/c") == -1, "open \"a/b/c\" (must return -1)");
+  CHECK(create("a/b/c", 0), "create \"a/b/c\"");
+  CHECK((fd = open("a/b/c")) > 1, "open \"a/b/c\"");
+  close(fd);
+
+  CHECK(remove("a/b/c"), "remove \"a/b/c\"");
+  CHECK(open("a/b/c") == -1, "open \"a/b/c\" (must return -1)");
+  CHECK(remove("a/b"), "rmdir \"a/b\"");
+  CHECK(!chdir("a/b"), "chdir \"a/b\" (must return false)");
+
+  CHECK(mkdir("a/b"), "mkdir \"a/b\"");
+  CHECK(open("a/b/c") == -1, "open \"a/b/c\" (must return -1)");
+  CHECK(create("a/b/c", 0), "create \"a/b/c\"");
+  CHECK(chdir("a/b"), "chdir \"a/b\"");
+  CHECK((fd = open("../b/c")) > 1, "open \"../b/c\"");
+  close(fd);
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-relookup) begin
+(dir-relookup) open "a/b/c" (must return -1)
+(dir-relookup) mkdir "a"
+(dir-relookup) mkdir "a/b"
+(dir-relookup) open "a/b/c" (must return -1)
+(dir-relookup) create "a/b/c"
+(dir-relookup) open "a/b/c"
+(dir-relookup) remove "a/b/c"
+(dir-relookup) open "a/b/c" (must return -1)
+(dir-relookup) rmdir "a/b"
+(dir-relookup) chdir "a/b" (must return false)
+(dir-relookup) mkdir "a/b"
+(dir-relookup) open "a/b/c" (must return -1)
+(dir-relookup) create "a/b/c"
+(dir-relookup) chdir "a/b"
+(dir-relookup) open "../b/c"
+(dir-relookup) end
+EOF
+pass;
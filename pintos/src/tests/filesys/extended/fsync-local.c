@@ -0,0 +1,63 @@
+/* Overwrites one file in place and appends to another, then
+   fdatasyncs the appended one.  That commits its new sectors, and
+   must write its data without writing the other file's dirty
+   sectors or evicting them from the cache.  Then fsyncs the
+   other. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define A_SECTORS 16
+#define B_SECTORS 32
+
+static char a[A_SECTORS * 512];
+static char b[B_SECTORS * 512];
+
+void test_main(void) {
+  unsigned long long wcnt;
+  int hits;
+  int fd_a, fd_b;
+
+  CHECK(create("a", 0), "create \"a\"");
+  CHECK(create("b", 0), "create \"b\"");
+  CHECK((fd_a = open("a")) > 1, "open \"a\"");
+  CHECK((fd_b = open("b")) > 1, "open \"b\"");
+  memset(a, 'A', sizeof a);
+  memset(b, 'b', sizeof b);
+  CHECK(write(fd_b, b, sizeof b) == sizeof b, "write \"b\"");
+  CHECK(fsync(fd_b), "fsync \"b\"");
+
+  memset(b, 'B', sizeof b);
+  seek(fd_b, 0);
+  CHECK(write(fd_b, b, sizeof b) == sizeof b, "overwrite \"b\"");
+  CHECK(write(fd_a, a, sizeof a) == sizeof a, "write \"a\"");
+
+  /* The commit adds a few journal writes for "a"'s inode and the
+     free map, but none of "b"'s overwritten sectors. */
+  wcnt = get_block_wcnt();
+  CHECK(fdatasync(fd_a), "fdatasync \"a\"");
+  wcnt = get_block_wcnt() - wcnt;
+  if (wcnt < A_SECTORS || wcnt >= A_SECTORS + B_SECTORS)
+    fail("fdatasync \"a\" wrote %llu sectors, expected about %d", wcnt, A_SECTORS);
+  msg("fdatasync \"a\" wrote only \"a\"");
+
+  /* Unlike flush_cache(), syncing one file leaves the rest of the
+     cache in place: rereading "b" hits on every sector. */
+  hit_rate();
+  seek(fd_b, 0);
+  CHECK(read(fd_b, b, sizeof b) == sizeof b, "read \"b\"");
+  hits = hit_rate();
+  if (hits < B_SECTORS)
+    fail("reading \"b\" hit the cache %d times, expected %d", hits, B_SECTORS);
+  msg("\"b\" is still cached");
+  CHECK(fsync(fd_b), "fsync \"b\"");
+
+  msg("close \"a\"");
+  close(fd_a);
+  msg("close \"b\"");
+  close(fd_b);
+  check_file("a", a, sizeof a);
+  check_file("b", b, sizeof b);
+}
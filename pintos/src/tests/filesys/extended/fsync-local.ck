@@ -0,0 +1,30 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fsync-local) begin
+(fsync-local) create "a"
+(fsync-local) create "b"
+(fsync-local) open "a"
+(fsync-local) open "b"
+(fsync-local) write "b"
+(fsync-local) fsync "b"
+(fsync-local) overwrite "b"
+(fsync-local) write "a"
+(fsync-local) fdatasync "a"
+(fsync-local) fdatasync "a" wrote only "a"
+(fsync-local) read "b"
+(fsync-local) "b" is still cached
+(fsync-local) fsync "b"
+(fsync-local) close "a"
+(fsync-local) close "b"
+(fsync-local) open "a" for verification
+(fsync-local) verified contents of "a"
+(fsync-local) close "a"
+(fsync-local) open "b" for verification
+(fsync-local) verified contents of "b"
+(fsync-local) close "b"
+(fsync-local) end
+EOF
+pass;
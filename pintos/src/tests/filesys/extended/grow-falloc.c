@@ -0,0 +1,35 @@
+/* Tests that preallocating space for a file with fallocate grows
+   it, that the reserved range reads as zeros, and that writing
+   into the middle of it leaves the rest zeroed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DATA_OFS 40000
+#define DATA_SIZE 512
+
+static char buf[76543];
+
+void test_main(void) {
+  const char* file_name = "testfile";
+  int fd;
+
+  CHECK(create(file_name, 0), "create \"%s\"", file_name);
+  CHECK((fd = open(file_name)) > 1, "open \"%s\"", file_name);
+  CHECK(fallocate(fd, 0, sizeof buf), "fallocate \"%s\"", file_name);
+  CHECK(filesize(fd) == sizeof buf, "filesize \"%s\"", file_name);
+  msg("close \"%s\"", file_name);
+  close(fd);
+  check_file(file_name, buf, sizeof buf);
+
+  memset(buf + DATA_OFS, 'x', DATA_SIZE);
+  CHECK((fd = open(file_name)) > 1, "open \"%s\"", file_name);
+  msg("seek \"%s\"", file_name);
+  seek(fd, DATA_OFS);
+  CHECK(write(fd, buf + DATA_OFS, DATA_SIZE) == DATA_SIZE, "write \"%s\"", file_name);
+  msg("close \"%s\"", file_name);
+  close(fd);
+  check_file(file_name, buf, sizeof buf);
+}
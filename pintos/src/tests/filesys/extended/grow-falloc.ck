@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-falloc) begin
+(grow-falloc) create "testfile"
+(grow-falloc) open "testfile"
+(grow-falloc) fallocate "testfile"
+(grow-falloc) filesize "testfile"
+(grow-falloc) close "testfile"
+(grow-falloc) open "testfile" for verification
+(grow-falloc) verified contents of "testfile"
+(grow-falloc) close "testfile"
+(grow-falloc) open "testfile"
+(grow-falloc) seek "testfile"
+(grow-falloc) write "testfile"
+(grow-falloc) close "testfile"
+(grow-falloc) open "testfile" for verification
+(grow-falloc) verified contents of "testfile"
+(grow-falloc) close "testfile"
+(grow-falloc) end
+EOF
+pass;
@@ -4,6 +4,7 @@
 #define CHUNK_SIZE 8
 #define CHUNK_CNT 512
 #define BUF_SIZE (CHUNK_SIZE * CHUNK_CNT)
+#define REREAD_CNT 16 /* Full passes each child makes once it is grown. */
 static const char file_name[] = "logfile";
 
 #endif /* tests/filesys/extended/syn-rw.h */
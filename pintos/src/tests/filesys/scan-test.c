@@ -0,0 +1,66 @@
+#include "tests/filesys/scan-test.h"
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+#define HOT_CNT 4
+#define HOT_SIZE 512
+#define STREAM_SIZE (384 * 512)
+
+static char buf[4096];
+static const char* hot_names[HOT_CNT] = {"hot0", "hot1", "hot2", "hot3"};
+static int hot_fds[HOT_CNT];
+
+/* Reads the one data sector of every hot file.  The files stay
+   open, so each pass makes exactly HOT_CNT cache accesses, and
+   read-ahead finds nothing past a file's only sector.  Returns
+   how many of those accesses hit. */
+static int read_hot(void) {
+  int i;
+
+  hit_rate();
+  for (i = 0; i < HOT_CNT; i++) {
+    seek(hot_fds[i], 0);
+    CHECK(read(hot_fds[i], buf, HOT_SIZE) == HOT_SIZE, "read \"%s\"", hot_names[i]);
+  }
+  return hit_rate();
+}
+
+/* Makes a few small files hot in the buffer cache, then reads
+   "stream", which is larger than the cache, through it once.
+   The stream is read backward in 4 kB blocks, so read-ahead
+   never kicks in and nothing enters the cache behind the test's
+   back.  Returns true if re-reading the hot files afterward hits
+   the cache on every access. */
+bool scan_test(void) {
+  size_t ofs;
+  int fd, i;
+
+  random_bytes(buf, sizeof buf);
+  for (i = 0; i < HOT_CNT; i++) {
+    CHECK(create(hot_names[i], 0), "create \"%s\"", hot_names[i]);
+    CHECK((hot_fds[i] = open(hot_names[i])) > 1, "open \"%s\"", hot_names[i]);
+    CHECK(write(hot_fds[i], buf, HOT_SIZE) == HOT_SIZE, "write \"%s\"", hot_names[i]);
+  }
+  CHECK(create("stream", 0), "create \"stream\"");
+  CHECK((fd = open("stream")) > 1, "open \"stream\"");
+  for (ofs = 0; ofs < STREAM_SIZE; ofs += sizeof buf)
+    CHECK(write(fd, buf, sizeof buf) == sizeof buf, "write \"stream\" at %zu", ofs);
+
+  /* Start from an empty cache, then touch the hot files twice so
+     they count as frequently used. */
+  flush_cache();
+  read_hot();
+  read_hot();
+  if (read_hot() != HOT_CNT)
+    fail("hot files not cached before streaming read");
+
+  for (ofs = STREAM_SIZE; ofs > 0; ofs -= sizeof buf) {
+    seek(fd, ofs - sizeof buf);
+    CHECK(read(fd, buf, sizeof buf) == sizeof buf, "read \"stream\" at %zu",
+          ofs - sizeof buf);
+  }
+  close(fd);
+
+  return read_hot() == HOT_CNT;
+}
@@ -0,0 +1,8 @@
+#ifndef TESTS_FILESYS_SCAN_TEST_H
+#define TESTS_FILESYS_SCAN_TEST_H
+
+#include <stdbool.h>
+
+bool scan_test(void);
+
+#endif /* tests/filesys/scan-test.h */
@@ -0,0 +1,93 @@
+/* Checks bitmap_scan() and bitmap_count() against bit-at-a-time
+   reference versions on a large, fragmented bitmap, then reports
+   how long each takes to answer the same scans.
+
+   The bitmap is mostly set, with a short clear run in every 64
+   bits and one long clear run near the end, much like the free
+   map of a nearly full disk. */
+
+#include <bitmap.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "devices/timer.h"
+
+#define BIT_CNT (1 << 18) /* Bits in the bitmap. */
+#define LONG_RUN 512      /* Length of the long clear run. */
+#define ROUNDS 4          /* Times each set of scans is timed. */
+
+/* Run lengths to scan for.  The longer ones only fit in the long
+   run, so finding them means crossing the whole bitmap. */
+static const size_t run_lengths[] = {1, 4, 12, 17, 100, LONG_RUN};
+#define RUN_LENGTH_CNT (sizeof run_lengths / sizeof *run_lengths)
+
+static size_t slow_scan(const struct bitmap*, size_t start, size_t cnt, bool value);
+static size_t slow_count(const struct bitmap*, size_t start, size_t cnt, bool value);
+
+void test_bitmap_scan(void) {
+  struct bitmap* b = bitmap_create(BIT_CNT);
+  int64_t start_time;
+  size_t i, r;
+
+  ASSERT(b != NULL);
+  random_init(0);
+  bitmap_set_all(b, true);
+  for (i = 0; i < BIT_CNT; i += 64) {
+    size_t len = random_ulong() % 16 + 1;
+    bitmap_set_multiple(b, i + random_ulong() % (64 - len), len, false);
+  }
+  bitmap_set_multiple(b, BIT_CNT - 2 * LONG_RUN, LONG_RUN, false);
+  msg("created %d-bit bitmap", BIT_CNT);
+
+  for (i = 0; i < RUN_LENGTH_CNT; i++) {
+    size_t cnt = run_lengths[i];
+    if (bitmap_scan(b, 0, cnt, false) != slow_scan(b, 0, cnt, false))
+      fail("scans for %zu clear bits disagree", cnt);
+    if (bitmap_scan(b, 12345, cnt, true) != slow_scan(b, 12345, cnt, true))
+      fail("scans for %zu set bits disagree", cnt);
+  }
+  if (bitmap_count(b, 7, BIT_CNT - 7, false) != slow_count(b, 7, BIT_CNT - 7, false))
+    fail("counts disagree");
+  msg("word and bit scans agree");
+
+  start_time = timer_ticks();
+  for (r = 0; r < ROUNDS; r++)
+    for (i = 0; i < RUN_LENGTH_CNT; i++)
+      bitmap_scan(b, 0, run_lengths[i], false);
+  msg("word scan: %" PRId64 " ticks", timer_elapsed(start_time));
+
+  start_time = timer_ticks();
+  for (r = 0; r < ROUNDS; r++)
+    for (i = 0; i < RUN_LENGTH_CNT; i++)
+      slow_scan(b, 0, run_lengths[i], false);
+  msg("bit scan: %" PRId64 " ticks", timer_elapsed(start_time));
+
+  bitmap_destroy(b);
+}
+
+/* bitmap_scan() as it was before it worked a word at a time. */
+static size_t slow_scan(const struct bitmap* b, size_t start, size_t cnt, bool value) {
+  if (cnt <= bitmap_size(b)) {
+    size_t last = bitmap_size(b) - cnt;
+    size_t i, j;
+    for (i = start; i <= last; i++) {
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test(b, i + j) != value)
+          break;
+      if (j == cnt)
+        return i;
+    }
+  }
+  return BITMAP_ERROR;
+}
+
+/* bitmap_count() as it was before it worked a word at a time. */
+static size_t slow_count(const struct bitmap* b, size_t start, size_t cnt, bool value) {
+  size_t i, value_cnt = 0;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test(b, start + i) == value)
+      value_cnt++;
+  return value_cnt;
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# Timings vary from run to run, so only their presence is checked.
+my ($timings) = scalar (grep (/^\(bitmap-scan\) (word|bit) scan: \d+ ticks$/, @output));
+fail "expected 2 timing lines, found $timings\n" if $timings != 2;
+@output = grep (!/^\(bitmap-scan\) (word|bit) scan: \d+ ticks$/, @output);
+compare_output ("run", \@output, [<<'EOF']);
+(bitmap-scan) begin
+(bitmap-scan) created 262144-bit bitmap
+(bitmap-scan) word and bit scans agree
+(bitmap-scan) end
+EOF
+pass;
@@ -34,6 +34,7 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -232,6 +233,19 @@ static char** parse_options(char** argv) {
       filesys_bdev_name = value;
     else if (!strcmp(name, "-scratch"))
       scratch_bdev_name = value;
+    else if (!strcmp(name, "-cache")) {
+      if (value != NULL && !strcmp(value, "lru"))
+        cache_policy = CACHE_LRU;
+      else if (value != NULL && !strcmp(value, "arc"))
+        cache_policy = CACHE_ARC;
+      else
+        PANIC("unknown cache policy `%s' (use -h for help)", value);
+    } else if (!strcmp(name, "-cache-size")) {
+      int sectors = value != NULL ? atoi(value) : 0;
+      if (sectors < CACHE_MIN_SIZE)
+        PANIC("cache size must be at least %d sectors (use -h for help)", CACHE_MIN_SIZE);
+      cache_size = sectors;
+    }
 #ifdef VM
     else if (!strcmp(name, "-swap"))
       swap_bdev_name = value;
@@ -348,6 +362,8 @@ static void usage(void) {
          "  -f                 Format file system device during startup.\n"
          "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
          "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+         "  -cache=POLICY      Use lru or arc (default) buffer cache replacement.\n"
+         "  -cache-size=N      Cache N sectors in the buffer cache (default 256).\n"
 #ifdef VM
          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
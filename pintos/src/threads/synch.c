@@ -298,3 +298,86 @@ void cond_broadcast(struct condition* cond, struct lock* lock) {
   while (!list_empty(&cond->waiters))
     cond_signal(cond, lock);
 }
+
+/* Initializes RWLOCK, which no thread holds at first. */
+void rwlock_init(struct rwlock* rwlock) {
+  ASSERT(rwlock != NULL);
+
+  lock_init(&rwlock->lock);
+  cond_init(&rwlock->readers_ok);
+  cond_init(&rwlock->writers_ok);
+  rwlock->readers = 0;
+  rwlock->waiting_writers = 0;
+  rwlock->writer = NULL;
+}
+
+/* Acquires RWLOCK for reading, sleeping while a writer holds it
+   or is waiting for it.  The current thread must not already
+   hold RWLOCK.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void rwlock_acquire_read(struct rwlock* rwlock) {
+  ASSERT(rwlock != NULL);
+  ASSERT(!intr_context());
+
+  lock_acquire(&rwlock->lock);
+  ASSERT(rwlock->writer != thread_current());
+  while (rwlock->writer != NULL || rwlock->waiting_writers > 0)
+    cond_wait(&rwlock->readers_ok, &rwlock->lock);
+  rwlock->readers++;
+  lock_release(&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread holds for reading. */
+void rwlock_release_read(struct rwlock* rwlock) {
+  ASSERT(rwlock != NULL);
+
+  lock_acquire(&rwlock->lock);
+  ASSERT(rwlock->readers > 0);
+  if (--rwlock->readers == 0)
+    cond_signal(&rwlock->writers_ok, &rwlock->lock);
+  lock_release(&rwlock->lock);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no other thread
+   holds it.  The current thread must not already hold RWLOCK.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void rwlock_acquire_write(struct rwlock* rwlock) {
+  ASSERT(rwlock != NULL);
+  ASSERT(!intr_context());
+
+  lock_acquire(&rwlock->lock);
+  ASSERT(rwlock->writer != thread_current());
+  rwlock->waiting_writers++;
+  while (rwlock->writer != NULL || rwlock->readers > 0)
+    cond_wait(&rwlock->writers_ok, &rwlock->lock);
+  rwlock->waiting_writers--;
+  rwlock->writer = thread_current();
+  lock_release(&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread holds for writing.
+   Hands it to the next waiting writer if there is one, otherwise
+   to every waiting reader. */
+void rwlock_release_write(struct rwlock* rwlock) {
+  ASSERT(rwlock != NULL);
+
+  lock_acquire(&rwlock->lock);
+  ASSERT(rwlock->writer == thread_current());
+  rwlock->writer = NULL;
+  if (rwlock->waiting_writers > 0)
+    cond_signal(&rwlock->writers_ok, &rwlock->lock);
+  else
+    cond_broadcast(&rwlock->readers_ok, &rwlock->lock);
+  lock_release(&rwlock->lock);
+}
+
+/* Returns true if the current thread holds RWLOCK for writing. */
+bool rwlock_held_for_write(const struct rwlock* rwlock) {
+  ASSERT(rwlock != NULL);
+
+  return rwlock->writer == thread_current();
+}
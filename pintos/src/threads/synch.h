@@ -38,6 +38,25 @@ void cond_wait(struct condition*, struct lock*);
 void cond_signal(struct condition*, struct lock*);
 void cond_broadcast(struct condition*, struct lock*);
 
+/* Readers-writer lock.  Any number of readers may hold it at
+   once, or a single writer.  Waiting writers keep new readers
+   out, so that a steady stream of readers cannot starve them. */
+struct rwlock {
+  struct lock lock;             /* Protects the members below. */
+  struct condition readers_ok;  /* Signaled when readers may enter. */
+  struct condition writers_ok;  /* Signaled when a writer may enter. */
+  unsigned readers;             /* Number of readers holding it. */
+  unsigned waiting_writers;     /* Number of writers waiting for it. */
+  struct thread* writer;        /* Writer holding it, if any. */
+};
+
+void rwlock_init(struct rwlock*);
+void rwlock_acquire_read(struct rwlock*);
+void rwlock_release_read(struct rwlock*);
+void rwlock_acquire_write(struct rwlock*);
+void rwlock_release_write(struct rwlock*);
+bool rwlock_held_for_write(const struct rwlock*);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
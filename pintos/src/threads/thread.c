@@ -14,6 +14,9 @@
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
+#ifdef FILESYS
+#include "filesys/directory.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
@@ -187,10 +190,12 @@ tid_t thread_create(const char* name, int priority, thread_func* function, void*
   sf->ebp = 0;
 
   /* Inherit parent CWD */
+#ifdef FILESYS
   if (thread_current()->cwd == NULL)
     t->cwd = NULL;
   else
     t->cwd = dir_reopen(thread_current()->cwd);
+#endif
   /* Add to run queue. */
   thread_unblock(t);
 
@@ -121,6 +121,7 @@ struct thread {
   struct list file_descriptors;
   int next_fd;
   struct dir* cwd;
+  int journal_depth; /* Nested journal_begin() calls, in filesys/journal.c. */
 
 #ifdef USERPROG
   /* Owned by userprog/process.c. */
@@ -29,6 +29,9 @@ void syscall_chdir(char* name, struct intr_frame *f);
 void syscall_readdir(int fd, char *name[NAME_MAX + 1], struct intr_frame *f);
 void syscall_inumber(int fd, struct intr_frame *f);
 void syscall_isdir(int fd, struct intr_frame *f);
+void syscall_fallocate(int fd, unsigned offset, unsigned length, struct intr_frame* f);
+void syscall_getdents(int fd, struct dirent* entries, unsigned size, struct intr_frame* f);
+void syscall_fsync(int fd, bool data_only, struct intr_frame* f);
 bool valid_fd(int fd_user);
 struct file* get_f_ptr(int fd);
 struct file_descriptor* get_fd_struct(int fd);
@@ -177,6 +180,25 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     case SYS_BLOCKWCNT:
       syscall_block_wcnt(f);
       break;
+    case SYS_FALLOCATE:
+      if (!check_addr(args + 4, 12)) {
+        syscall_exit(-1, f);
+      }
+      syscall_fallocate((int)args[1], (unsigned)args[2], (unsigned)args[3], f);
+      break;
+    case SYS_GETDENTS:
+      if (!check_addr(args + 4, 12)) {
+        syscall_exit(-1, f);
+      }
+      syscall_getdents((int)args[1], (struct dirent*)args[2], (unsigned)args[3], f);
+      break;
+    case SYS_FSYNC:
+    case SYS_FDATASYNC:
+      if (!check_addr(args + 4, 4)) {
+        syscall_exit(-1, f);
+      }
+      syscall_fsync((int)args[1], args[0] == SYS_FDATASYNC, f);
+      break;
     default:
       /* PANIC? */
       syscall_exit(-1, f);
@@ -561,3 +583,61 @@ syscall_block_wcnt(struct intr_frame *f) {
   f->eax = get_block_write_cnt();
 }
 
+/* HELPER FUNCTION
+ * Handles the fallocate routine. Reserves disk space for part of a
+ * file without writing it, growing the file if needed.
+ * @fd, file descriptor
+ * @offset, first byte to reserve
+ * @length, number of bytes to reserve
+ */
+void syscall_fallocate(int fd, unsigned offset, unsigned length, struct intr_frame* f) {
+  struct file_descriptor* file_des = get_fd_struct(fd);
+  if (file_des == NULL || file_des->is_dir) {
+    f->eax = false;
+    return;
+  }
+  f->eax = file_allocate(file_des->f_ptr, (off_t)offset, (off_t)length);
+}
+
+/* HELPER FUNCTION
+ * Handles the getdents routine. Reads as many entries of a directory
+ * as fit in a buffer with one trap, instead of one readdir, isdir and
+ * inumber per entry.
+ * @fd, fd of the directory
+ * @entries, buffer for the entries
+ * @size, size of the buffer in bytes
+ */
+void syscall_getdents(int fd, struct dirent* entries, unsigned size, struct intr_frame* f) {
+  struct file_descriptor* file_des = get_fd_struct(fd);
+  size_t cnt = size / sizeof *entries;
+  if (file_des == NULL || !file_des->is_dir) {
+    f->eax = -1;
+    return;
+  }
+  if (cnt == 0 || file_des->f_ptr->inode->removed) {
+    f->eax = 0;
+    return;
+  }
+  if (!check_addr(entries, cnt * sizeof *entries)) {
+    syscall_exit(-1, f);
+  }
+  f->eax = dir_readdir_batch((struct dir*)file_des->f_ptr, entries, cnt);
+}
+
+/* HELPER FUNCTION
+ * Handles the fsync and fdatasync routines. Writes the dirty data of
+ * one file or directory to disk and commits its metadata. Other files'
+ * dirty data stays in the cache, except sectors newly allocated by the
+ * journal transaction being committed.
+ * @fd, file descriptor
+ * @data_only, true for fdatasync, which skips the journal commit
+ *   unless the file's length or sectors changed
+ */
+void syscall_fsync(int fd, bool data_only, struct intr_frame* f) {
+  struct file_descriptor* file_des = get_fd_struct(fd);
+  if (file_des == NULL) {
+    f->eax = false;
+    return;
+  }
+  f->eax = file_sync(file_des->f_ptr, data_only);
+}